@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "accel.h"
+
+// The cycles and instructions the ROM would have taken
+typedef struct COST {
+    uint32_t cycles;
+    uint32_t instructions;
+} COST;
+
+void prtbyt_accel(KIM1Machine *m);
+void pack_accel(KIM1Machine *m);
+void chk_accel(KIM1Machine *m);
+void ak_accel(KIM1Machine *m);
+void getkey_accel(KIM1Machine *m);
+void scand_accel(KIM1Machine *m);
+void scands_accel(KIM1Machine *m);
+
+ACCEL accels[] = {
+    { "prtbyt", ACCEL_PRTBYT, 0x1e3b, prtbyt_accel, { { 0x1e3b, 0x1e59 }, { 0x1ea0, 0x1ea0 } } },
+    { "pack", ACCEL_PACK, 0x1fac, pack_accel, { { 0x1fac, 0x1fcb } } },
+    { "chk", ACCEL_CHK, 0x1f91, chk_accel, { { 0x1f91, 0x1f9c } } },
+    { "ak", ACCEL_AK, 0x1efe, ak_accel, { { 0x1efe, 0x1f18 } } },
+    { "getkey", ACCEL_GETKEY, 0x1f6a, getkey_accel, { { 0x1f6a, 0x1f90 }, { 0x1f02, 0x1f18 } } },
+    { "scand", ACCEL_SCAND, 0x1f19, scand_accel, { { 0x1f19, 0x1f62 }, { 0x1efe, 0x1f18 } } },
+    { "scands", ACCEL_SCAND, 0x1f1f, scands_accel, { { 0x1f1f, 0x1f62 }, { 0x1efe, 0x1f18 } } },
+};
+
+#define NUM_ACCELS (int) (sizeof(accels) / sizeof(accels[0]))
+int num_accels = NUM_ACCELS;
+
+/* Parse a comma separated list of accelerator names, or all or none */
+int accel_parse(char *list, uint32_t *mask) {
+    char name[32];
+    int len, i;
+
+    *mask = 0;
+    while (*list) {
+        len = strcspn(list, ",");
+        if (len >= (int) sizeof(name)) {
+            return -1;
+        }
+        memcpy(name, list, len);
+        name[len] = 0;
+        list += len + (list[len] == ',');
+
+        if (!strcmp(name, "all")) {
+            *mask |= ACCEL_ALL;
+            continue;
+        } else if (!strcmp(name, "none")) {
+            continue;
+        }
+        for (i=0; i < NUM_ACCELS; i++) {
+            if (!strcmp(name, accels[i].name)) break;
+        }
+        if (i == NUM_ACCELS) {
+            return -1;
+        }
+        *mask |= accels[i].flag;
+    }
+    return 0;
+}
+
+/* Turn the accelerators in mask on and the rest off */
+void kim1_set_accel(KIM1Machine *m, uint32_t mask) {
+    for (int i=0; i < NUM_ACCELS; i++) {
+        kim1_remove_trap(m, accels[i].addr, accels[i].handler);
+        if (mask & accels[i].flag) {
+            kim1_add_trap(m, accels[i].addr, accels[i].handler);
+        }
+    }
+}
+
+/* Traps the native versions already do what they would: the machine's
+ * own display, keyboard and OUTCH traps, and the accelerators themselves */
+static int accel_own_trap(TRAP_HANDLER handler) {
+    if ((handler == display_trap) || (handler == key_read_trap) || (handler == outch_trap)) {
+        return 1;
+    }
+    for (int i=0; i < NUM_ACCELS; i++) {
+        if (handler == accels[i].handler) return 1;
+    }
+    return 0;
+}
+
+/* Is there any other trap in the ROM code the accelerator at the pc
+ * stands in for */
+static int accel_trapped(KIM1Machine *m) {
+    ACCEL *a = NULL;
+    RANGE *r;
+
+    for (int i=0; i < NUM_ACCELS; i++) {
+        if (accels[i].addr == m->cpu.pc) a = &accels[i];
+    }
+    if (a == NULL) {
+        return 0;
+    }
+    for (r = a->ranges; (r < a->ranges + 2) && r->hi; r++) {
+        for (uint32_t addr = r->lo; addr <= r->hi; addr++) {
+            if (!(m->trap_map[addr >> 3] & (1 << (addr & 7)))) continue;
+            for (int i=0; i < m->num_traps; i++) {
+                if ((m->traps[i].addr == addr) && !accel_own_trap(m->traps[i].handler)) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* The ROM runs the routine itself while the trace or profile needs to see
+ * every instruction, in decimal mode, which changes what ADC does, if a
+ * trap before this one has stopped the machine, and if a breakpoint or
+ * other trap is waiting somewhere in the code it would run. */
+int accel_off(KIM1Machine *m) {
+    return m->trace || m->profile || m->stopped || (m->cpu.status & FLAG_DECIMAL) ||
+        accel_trapped(m);
+}
+
+// Charge one instruction
+static void op(COST *k, int cycles) {
+    k->cycles += cycles;
+    k->instructions++;
+}
+
+static uint8_t nz(CPU6502 *c, uint8_t v) {
+    c->status = (c->status & ~(FLAG_ZERO | FLAG_SIGN)) | (v ? 0 : FLAG_ZERO) | (v & FLAG_SIGN);
+    return v;
+}
+
+static void carry(CPU6502 *c, int set) {
+    c->status = set ? c->status | FLAG_CARRY : c->status & ~FLAG_CARRY;
+}
+
+static void adc(CPU6502 *c, uint8_t v) {
+    uint16_t sum = c->a + v + (c->status & FLAG_CARRY);
+
+    carry(c, sum > 0xff);
+    c->status &= ~FLAG_OVERFLOW;
+    if ((sum ^ c->a) & (sum ^ v) & 0x80) {
+        c->status |= FLAG_OVERFLOW;
+    }
+    c->a = nz(c, sum);
+}
+
+static void cmp(CPU6502 *c, uint8_t r, uint8_t v) {
+    carry(c, r >= v);
+    nz(c, r - v);
+}
+
+static uint8_t lsr(CPU6502 *c, uint8_t v) {
+    carry(c, v & 1);
+    return nz(c, v >> 1);
+}
+
+static uint8_t asl(CPU6502 *c, uint8_t v) {
+    carry(c, v & 0x80);
+    return nz(c, v << 1);
+}
+
+static uint8_t rol(CPU6502 *c, uint8_t v) {
+    uint8_t in = c->status & FLAG_CARRY;
+
+    carry(c, v & 0x80);
+    return nz(c, (v << 1) | in);
+}
+
+/* A JSR followed by its RTS leaves the return address behind on the
+ * stack, just below where the caller's stack pointer is */
+static void jsr_bytes(KIM1Machine *m, uint16_t from) {
+    CPU6502 *c = &m->cpu;
+
+    write6502(c, 0x100 + c->sp, (from + 2) >> 8);
+    write6502(c, 0x100 + (uint8_t) (c->sp - 1), (from + 2) & 0xff);
+}
+
+/* Add up what the ROM would have taken and return to the caller. The
+ * cost includes the routine's own RTS. */
+static void accel_return(KIM1Machine *m, COST *k) {
+    m->cpu.clockticks6502 += k->cycles;
+    m->cpu.instructions += k->instructions;
+    trap_rts(m);
+}
+
+/* HEXTA, the low nibble of A as an ASCII hex digit, which it sends by
+ * jumping to OUTCH. outch_trap takes no cycles over that. */
+static void hexta(KIM1Machine *m, COST *k) {
+    CPU6502 *c = &m->cpu;
+
+    c->a = nz(c, c->a & 0x0f); op(k, 2);
+    cmp(c, c->a, 0x0a); op(k, 2);
+    carry(c, 0); op(k, 2);
+    if (c->status & FLAG_SIGN) {
+        op(k, 3);
+    } else {
+        op(k, 2);
+        adc(c, 0x07); op(k, 2);
+    }
+    adc(c, 0x30); op(k, 2);
+    op(k, 3);
+    outch(m);
+}
+
+/* PRTBYT. Only with fast TTY, which is what outch_trap does, otherwise
+ * the ROM sends the bits itself. */
+void prtbyt_accel(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    COST k = { 0, 0 };
+
+    if (accel_off(m) || !m->fast_tty) {
+        return;
+    }
+    write6502(c, 0xfc, c->a); op(&k, 3);
+    for (int i=0; i < 4; i++) {
+        c->a = lsr(c, c->a); op(&k, 2);
+    }
+    jsr_bytes(m, 0x1e41); op(&k, 6);
+    hexta(m, &k);
+    c->a = nz(c, read6502(c, 0xfc)); op(&k, 3);
+    jsr_bytes(m, 0x1e46); op(&k, 6);
+    hexta(m, &k);
+    c->a = nz(c, read6502(c, 0xfc)); op(&k, 3);
+    op(&k, 6);
+    accel_return(m, &k);
+}
+
+/* PACK, shift the hex digit in A into INL/INH. Anything else comes back
+ * with the flags from the compare that rejected it. */
+void pack_accel(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    COST k = { 0, 0 };
+
+    if (accel_off(m)) {
+        return;
+    }
+    cmp(c, c->a, 0x30); op(&k, 2);
+    if (c->status & FLAG_SIGN) {
+        op(&k, 3);
+    } else {
+        op(&k, 2);
+        cmp(c, c->a, 0x47); op(&k, 2);
+        if (!(c->status & FLAG_SIGN)) {
+            op(&k, 3);
+        } else {
+            op(&k, 2);
+            cmp(c, c->a, 0x40); op(&k, 2);
+            if (c->status & FLAG_SIGN) {
+                op(&k, 3);
+            } else {
+                op(&k, 2);
+                carry(c, 0); op(&k, 2);
+                adc(c, 0x09); op(&k, 2);
+            }
+            for (int i=0; i < 4; i++) {
+                c->a = rol(c, c->a); op(&k, 2);
+            }
+            c->y = nz(c, 4); op(&k, 2);
+            do {
+                c->a = rol(c, c->a); op(&k, 2);
+                write6502(c, 0xf8, rol(c, read6502(c, 0xf8))); op(&k, 5);
+                write6502(c, 0xf9, rol(c, read6502(c, 0xf9))); op(&k, 5);
+                c->y = nz(c, c->y - 1); op(&k, 2);
+                op(&k, c->y ? 3 : 2);
+            } while (c->y);
+            c->a = nz(c, 0); op(&k, 2);
+        }
+    }
+    op(&k, 6);
+    accel_return(m, &k);
+}
+
+/* CHK, add A to the 16-bit checksum in CHKL/CHKH */
+void chk_accel(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    COST k = { 0, 0 };
+
+    if (accel_off(m)) {
+        return;
+    }
+    carry(c, 0); op(&k, 2);
+    adc(c, read6502(c, 0xf7)); op(&k, 3);
+    write6502(c, 0xf7, c->a); op(&k, 3);
+    c->a = nz(c, read6502(c, 0xf6)); op(&k, 3);
+    adc(c, 0); op(&k, 2);
+    write6502(c, 0xf6, c->a); op(&k, 3);
+    op(&k, 6);
+    accel_return(m, &k);
+}
+
+/* The keypad scan from 1f02 to the RTS: AND together Y rows of the keypad
+ * starting with the one X selects, and leave A non-zero if a key in them
+ * is down */
+static void keyscan(KIM1Machine *m, COST *k) {
+    CPU6502 *c = &m->cpu;
+
+    c->a = nz(c, 0xff); op(k, 2);
+    do {
+        write6502(c, 0x1742, c->x); op(k, 4);
+        c->x = nz(c, c->x + 1); op(k, 2);
+        c->x = nz(c, c->x + 1); op(k, 2);
+        c->a = nz(c, c->a & read6502(c, 0x1740)); op(k, 4);
+        c->y = nz(c, c->y - 1); op(k, 2);
+        op(k, c->y ? 3 : 2);
+    } while (c->y);
+    c->y = nz(c, 7); op(k, 2);
+    write6502(c, 0x1742, c->y); op(k, 4);
+    c->a = nz(c, c->a | 0x80); op(k, 2);
+    c->a = nz(c, c->a ^ 0xff); op(k, 2);
+    op(k, 6);
+}
+
+/* AK, is any key down */
+void ak_accel(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    COST k = { 0, 0 };
+
+    if (accel_off(m)) {
+        return;
+    }
+    c->y = nz(c, 3); op(&k, 2);
+    c->x = nz(c, 1); op(&k, 2);
+    keyscan(m, &k);
+    accel_return(m, &k);
+}
+
+/* GETKEY, scan the rows one at a time and turn the first key down into
+ * its number, or 15 for none. Both ways out pass key_read_trap. */
+void getkey_accel(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    COST k = { 0, 0 };
+
+    if (accel_off(m)) {
+        return;
+    }
+    c->x = nz(c, 0x21); op(&k, 2);
+    for (;;) {
+        c->y = nz(c, 1); op(&k, 2);
+        jsr_bytes(m, 0x1f6e); op(&k, 6);
+        keyscan(m, &k);
+        if (!(c->status & FLAG_ZERO)) {
+            op(&k, 3);
+            break;
+        }
+        op(&k, 2);
+        cmp(c, c->x, 0x27); op(&k, 2);
+        if (c->status & FLAG_ZERO) {
+            op(&k, 2);
+            c->a = nz(c, 0x15); op(&k, 2);
+            m->char_pending = 0x15;
+            op(&k, 6);
+            accel_return(m, &k);
+            return;
+        }
+        op(&k, 3);
+    }
+
+    // Count the column from the top bit down
+    c->y = nz(c, 0xff); op(&k, 2);
+    for (;;) {
+        c->a = asl(c, c->a); op(&k, 2);
+        if (c->status & FLAG_CARRY) {
+            op(&k, 3);
+            break;
+        }
+        op(&k, 2);
+        c->y = nz(c, c->y + 1); op(&k, 2);
+        if (c->status & FLAG_SIGN) {
+            op(&k, 2);
+            break;
+        }
+        op(&k, 3);
+    }
+    // and add 7 for each row after the first
+    c->a = nz(c, c->x); op(&k, 2);
+    c->a = nz(c, c->a & 0x0f); op(&k, 2);
+    c->a = lsr(c, c->a); op(&k, 2);
+    c->x = nz(c, c->a); op(&k, 2);
+    c->a = nz(c, c->y); op(&k, 2);
+    if (!(c->status & FLAG_SIGN)) {
+        op(&k, 3);
+    } else {
+        op(&k, 2);
+        carry(c, 0); op(&k, 2);
+        adc(c, 0x07); op(&k, 2);
+    }
+    for (;;) {
+        c->x = nz(c, c->x - 1); op(&k, 2);
+        if (!c->x) {
+            op(&k, 2);
+            break;
+        }
+        op(&k, 3);
+        carry(c, 0); op(&k, 2);
+        adc(c, 0x07); op(&k, 2);
+    }
+    m->char_pending = 0x15;
+    op(&k, 6);
+    accel_return(m, &k);
+}
+
+/* CONVD, light one digit. display_trap cuts it short, skipping the write
+ * of the segments to the port and the delay after. */
+static void convd(KIM1Machine *m, COST *k) {
+    CPU6502 *c = &m->cpu;
+
+    write6502(c, 0xfc, c->y); op(k, 3);
+    c->y = nz(c, c->a); op(k, 2);
+    c->a = nz(c, read6502(c, 0x1fe7 + c->y)); op(k, 0xe7 + c->y > 0xff ? 5 : 4);
+    c->y = nz(c, 0); op(k, 2);
+    write6502(c, 0x1740, c->y); op(k, 4);
+    write6502(c, 0x1742, c->x); op(k, 4);
+    display_digit(m, c->x, c->a);
+    c->x = nz(c, c->x + 1); op(k, 2);
+    c->x = nz(c, c->x + 1); op(k, 2);
+    c->y = nz(c, read6502(c, 0xfc)); op(k, 3);
+    op(k, 6);
+}
+
+/* SCANDS, show the six digits in POINTH, POINTL and INH, then go on to
+ * AK */
+static void scands(KIM1Machine *m, COST *k) {
+    CPU6502 *c = &m->cpu;
+
+    c->a = nz(c, 0x7f); op(k, 2);
+    write6502(c, 0x1741, c->a); op(k, 4);
+    c->x = nz(c, 0x09); op(k, 2);
+    c->y = nz(c, 0x03); op(k, 2);
+    do {
+        c->a = nz(c, read6502(c, 0xf8 + c->y)); op(k, 4);
+        for (int i=0; i < 4; i++) {
+            c->a = lsr(c, c->a); op(k, 2);
+        }
+        jsr_bytes(m, 0x1f2f); op(k, 6);
+        convd(m, k);
+        c->a = nz(c, read6502(c, 0xf8 + c->y)); op(k, 4);
+        c->a = nz(c, c->a & 0x0f); op(k, 2);
+        jsr_bytes(m, 0x1f37); op(k, 6);
+        convd(m, k);
+        c->y = nz(c, c->y - 1); op(k, 2);
+        op(k, c->y ? 3 : 2);
+    } while (c->y);
+    write6502(c, 0x1742, c->x); op(k, 4);
+    c->a = nz(c, 0); op(k, 2);
+    write6502(c, 0x1741, c->a); op(k, 4);
+    op(k, 3);
+    c->y = nz(c, 3); op(k, 2);
+    c->x = nz(c, 1); op(k, 2);
+    keyscan(m, k);
+}
+
+void scands_accel(KIM1Machine *m) {
+    COST k = { 0, 0 };
+
+    if (accel_off(m)) {
+        return;
+    }
+    scands(m, &k);
+    accel_return(m, &k);
+}
+
+/* SCAND, show the byte POINT points at along with the address */
+void scand_accel(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    COST k = { 0, 0 };
+    uint16_t point;
+
+    if (accel_off(m)) {
+        return;
+    }
+    c->y = nz(c, 0); op(&k, 2);
+    point = read6502(c, 0xfa) | (read6502(c, 0xfb) << 8);
+    c->a = nz(c, read6502(c, point)); op(&k, 5);
+    write6502(c, 0xf9, c->a); op(&k, 3);
+    scands(m, &k);
+    accel_return(m, &k);
+}
@@ -0,0 +1,43 @@
+/* Native versions of the ROM routines programs call the most. Each one is
+ * a trap on the routine's entry point that does everything the ROM would:
+ * the same registers, flags, memory, I/O and leftover stack bytes, and the
+ * same cycles and instructions added to the counters, so a program can't
+ * tell the difference except by how fast it runs. kim1-check compares
+ * each one with the ROM itself on random machine states. */
+#ifndef ACCEL_H
+#define ACCEL_H
+
+#include <stdint.h>
+#include "kim1machine.h"
+
+#define ACCEL_PRTBYT 0x01       // 1e3b, print A as two hex digits
+#define ACCEL_PACK 0x02         // 1fac, shift a hex digit into f8/f9
+#define ACCEL_CHK 0x04          // 1f91, add A to the checksum in f6/f7
+#define ACCEL_AK 0x08           // 1efe, is any key down
+#define ACCEL_GETKEY 0x10       // 1f6a, which key is down
+#define ACCEL_SCAND 0x20        // 1f19 and 1f1f, light the display
+#define ACCEL_ALL 0x3f
+
+// The ROM code a routine runs, other than its entry point: where it
+// goes and the subroutines it calls. A trap anywhere in there, a
+// breakpoint say, would be skipped by the native version.
+typedef struct RANGE {
+    uint16_t lo, hi;
+} RANGE;
+
+typedef struct ACCEL {
+    char *name;
+    uint32_t flag;
+    uint16_t addr;
+    TRAP_HANDLER handler;
+    RANGE ranges[2];            // unused ones are 0, 0
+} ACCEL;
+
+// Every accelerator, kim1-check runs through them all
+extern ACCEL accels[];
+extern int num_accels;
+
+int accel_parse(char *list, uint32_t *mask);
+void kim1_set_accel(KIM1Machine *m, uint32_t mask);
+
+#endif
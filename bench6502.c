@@ -0,0 +1,110 @@
+/* bench6502 measures the raw speed of the fake6502 core. It runs a small
+ * fixed workload (indexed loads and stores, ADC, EOR, shifts, branches and
+ * JSR/RTS) out of a flat 64K memory with no KIM-1 devices attached, so the
+ * result is purely the cost of fetching, dispatching and executing opcodes.
+ *
+ * The same bench6502.o is linked against both the fused core (bench6502)
+ * and the reference table core (bench6502-table). The final state checksum
+ * printed at the end should be identical for both. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include "fake6502.h"
+
+uint8_t mem[65536];
+
+uint8_t read6502(CPU6502 *c, uint16_t address) {
+    return mem[address];
+}
+
+void write6502(CPU6502 *c, uint16_t address, uint8_t value) {
+    mem[address] = value;
+}
+
+uint8_t workload[] = {
+    0xa2, 0x00,             // 0200 LDX #$00
+    0xa0, 0x00,             // 0202 LDY #$00
+    0xb9, 0x00, 0x03,       // 0204 LDA $0300,Y
+    0x18,                   // 0207 CLC
+    0x69, 0x07,             // 0208 ADC #$07
+    0x99, 0x00, 0x04,       // 020a STA $0400,Y
+    0x45, 0x10,             // 020d EOR $10
+    0x85, 0x10,             // 020f STA $10
+    0x0a,                   // 0211 ASL A
+    0xc8,                   // 0212 INY
+    0xd0, 0xef,             // 0213 BNE $0204
+    0xe8,                   // 0215 INX
+    0x20, 0x1c, 0x02,       // 0216 JSR $021C
+    0x4c, 0x02, 0x02,       // 0219 JMP $0202
+    0x48,                   // 021c PHA
+    0x68,                   // 021d PLA
+    0x60,                   // 021e RTS
+};
+
+double now_seconds() {
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t total_cycles = 200000000;
+    uint32_t chunk = 1000000;
+    uint32_t done, start_instructions, checksum;
+    double start, elapsed;
+    CPU6502 cpu;
+    int nomap = 0;
+    char *end;
+
+    for (int i=1; i < argc; i++) {
+        if (!strcmp(argv[i], "-nomap")) {
+            nomap = 1;
+        } else {
+            total_cycles = strtoul(argv[i], &end, 0);
+            if (!isdigit(argv[i][0]) || *end || (total_cycles == 0)) {
+                printf("Usage:  bench6502 [cycles] [-nomap]\n");
+                return 1;
+            }
+        }
+    }
+
+    memset(mem, 0, sizeof(mem));
+    for (int i=0; i < 256; i++) {
+        mem[0x300 + i] = (uint8_t) (i * 37);
+    }
+    memcpy(&mem[0x200], workload, sizeof(workload));
+    mem[0xfffc] = 0x00;
+    mem[0xfffd] = 0x02;
+
+    memset(&cpu, 0, sizeof(cpu));
+    if (nomap) {
+        // Leave the memory map empty so every access goes through
+        // read6502/write6502
+    } else {
+        for (int page=0; page < 256; page++) {
+            cpu.readmap[page] = &mem[page * 256];
+            cpu.writemap[page] = &mem[page * 256];
+        }
+    }
+    reset6502(&cpu);
+
+    start_instructions = cpu.instructions;
+    start = now_seconds();
+    for (done = 0; done < total_cycles; done += chunk) {
+        exec6502(&cpu, chunk);
+    }
+    elapsed = now_seconds() - start;
+
+    checksum = cpu.pc ^ (cpu.a << 8) ^ (cpu.x << 16) ^ (cpu.y << 24) ^ cpu.status;
+    for (int i=0; i < 65536; i++) {
+        checksum = checksum * 31 + mem[i];
+    }
+
+    printf("%s core: %u instructions, %u cycles in %.3f s = %.1f M instructions/s (%.1f emulated MHz), state %08x\n",
+            core6502, cpu.instructions - start_instructions, done, elapsed,
+            (cpu.instructions - start_instructions) / elapsed / 1e6, done / elapsed / 1e6, checksum);
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debugger.h"
+#include "disasm.h"
+#include "input.h"
+
+static void show_help() {
+    printf("r                    show the registers\n");
+    printf("m addr [len]         dump memory\n");
+    printf("d [addr] [n]         disassemble n instructions from addr or the pc\n");
+    printf("b [addr]             set a breakpoint, or list breakpoints and watchpoints\n");
+    printf("w lo[-hi] [r|w|rw]   watch reads and/or writes, writes by default\n");
+    printf("x lo[-hi]            delete the breakpoints and watchpoints there\n");
+    printf("s [n]                step n instructions\n");
+    printf("c                    continue\n");
+}
+
+/* Disassemble n instructions starting at addr, returns the address after */
+static uint16_t disassemble(KIM1Machine *m, uint16_t addr, int n) {
+    uint8_t bytes[3];
+    char text[64];
+    int len;
+
+    for (int i=0; i < n; i++) {
+        for (int j=0; j < 3; j++) {
+            bytes[j] = kim1_peek(m, addr + j);
+        }
+        len = disasm6502(addr, bytes, text, sizeof(text));
+        printf("%s%04x  %s\n", kim1_is_breakpoint(m, addr) ? "*" : " ", addr, text);
+        addr += len;
+    }
+    return addr;
+}
+
+static void show_registers(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    char flags[9] = "NV-BDIZC";
+
+    for (int i=0; i < 8; i++) {
+        if (!(c->status & (0x80 >> i))) {
+            flags[i] = '.';
+        }
+    }
+    printf("pc=%04x a=%02x x=%02x y=%02x sp=%02x p=%02x %s  cycle %llu\n",
+            c->pc, c->a, c->x, c->y, c->sp, c->status, flags, (unsigned long long) kim1_cycles(m));
+    disassemble(m, c->pc, 1);
+}
+
+static void dump_memory(KIM1Machine *m, uint16_t addr, int len) {
+    for (int i=0; i < len; i += 16) {
+        printf("%04x ", (uint16_t) (addr + i));
+        for (int j=0; (j < 16) && (i + j < len); j++) {
+            printf(" %02x", kim1_peek(m, addr + i + j));
+        }
+        printf("\n");
+    }
+}
+
+static void list_points(KIM1Machine *m) {
+    for (int i=0; i < m->num_traps; i++) {
+        if (m->traps[i].handler == breakpoint_trap) {
+            printf("break %04x\n", m->traps[i].addr);
+        }
+    }
+    for (int i=0; i < m->num_watches; i++) {
+        WATCH *w = &m->watches[i];
+        printf("watch %04x-%04x %s%s\n", w->lo, w->hi,
+                (w->flags & WATCH_READ) ? "r" : "", (w->flags & WATCH_WRITE) ? "w" : "");
+    }
+}
+
+/* Parse lo or lo-hi, in hex */
+static int parse_range(char *arg, uint16_t *lo, uint16_t *hi) {
+    unsigned int l, h;
+    int n = sscanf(arg, "%x-%x", &l, &h);
+
+    if (n < 1) {
+        return -1;
+    }
+    *lo = l;
+    *hi = n == 2 ? h : l;
+    return *lo <= *hi ? 0 : -1;
+}
+
+static void show_hit(KIM1Machine *m) {
+    if (m->debug_hit == DEBUG_BREAK) {
+        printf("Breakpoint at %04x\n", m->debug_addr);
+    } else if (m->debug_hit == DEBUG_READ) {
+        printf("Watchpoint: read %02x from %04x\n", m->debug_value, m->debug_addr);
+    } else if (m->debug_hit == DEBUG_WRITE) {
+        printf("Watchpoint: write %02x to %04x\n", m->debug_value, m->debug_addr);
+    }
+    m->debug_hit = DEBUG_NONE;
+}
+
+void debugger_console(KIM1Machine *m) {
+    char line[256], cmd[16], arg1[64], arg2[64];
+    uint16_t lo, hi, next = m->cpu.pc;
+    uint8_t flags;
+    int n;
+
+    show_hit(m);
+    show_registers(m);
+    for (;;) {
+        printf("debug> ");
+        fflush(stdout);
+        if (input_read_line(line, sizeof(line)) < 0) {
+            return;
+        }
+        arg1[0] = arg2[0] = 0;
+        if ((n = sscanf(line, "%15s %63s %63s", cmd, arg1, arg2)) < 1) {
+            continue;
+        }
+
+        if (!strcmp(cmd, "c")) {
+            return;
+        } else if (!strcmp(cmd, "r")) {
+            show_registers(m);
+        } else if (!strcmp(cmd, "m")) {
+            if (parse_range(arg1, &lo, &hi) < 0) {
+                printf("m addr [len]\n");
+                continue;
+            }
+            dump_memory(m, lo, arg2[0] ? strtol(arg2, NULL, 16) : 64);
+        } else if (!strcmp(cmd, "d")) {
+            if (arg1[0] && (parse_range(arg1, &lo, &hi) == 0)) {
+                next = lo;
+            } else if (!arg1[0]) {
+                next = m->cpu.pc;
+            }
+            next = disassemble(m, next, arg2[0] ? atoi(arg2) : 10);
+        } else if (!strcmp(cmd, "b")) {
+            if (!arg1[0]) {
+                list_points(m);
+            } else if (parse_range(arg1, &lo, &hi) < 0) {
+                printf("b addr\n");
+            } else if (kim1_add_breakpoint(m, lo) < 0) {
+                printf("Too many traps\n");
+            }
+        } else if (!strcmp(cmd, "w")) {
+            if (parse_range(arg1, &lo, &hi) < 0) {
+                printf("w lo[-hi] [r|w|rw]\n");
+                continue;
+            }
+            flags = 0;
+            if (strchr(arg2, 'r')) flags |= WATCH_READ;
+            if (strchr(arg2, 'w') || !flags) flags |= WATCH_WRITE;
+            if (kim1_add_watch(m, lo, hi, flags) < 0) {
+                printf("Too many watchpoints\n");
+            }
+        } else if (!strcmp(cmd, "x")) {
+            if (parse_range(arg1, &lo, &hi) < 0) {
+                printf("x lo[-hi]\n");
+                continue;
+            }
+            for (uint32_t addr = lo; addr <= hi; addr++) {
+                kim1_remove_breakpoint(m, addr);
+            }
+            kim1_remove_watch(m, lo, hi);
+        } else if (!strcmp(cmd, "s")) {
+            n = arg1[0] ? atoi(arg1) : 1;
+            // Step the instruction even if the machine is parked idle there
+            m->idle_trap = NULL;
+            for (int i=0; (i < n) && !m->stopped; i++) {
+                kim1_run(m, 1);
+            }
+            m->stopped = 0;
+            show_hit(m);
+            show_registers(m);
+        } else {
+            show_help();
+        }
+    }
+}
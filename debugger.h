@@ -0,0 +1,11 @@
+/* The debugger console. It is opened from the keyboard with shift-D or
+ * when a breakpoint or watchpoint stops the machine, and reads commands a
+ * line at a time until told to continue. */
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "kim1machine.h"
+
+void debugger_console(KIM1Machine *m);
+
+#endif
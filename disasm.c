@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "disasm.h"
+
+// Addressing modes, named as in fake6502.c
+#define IMP 0
+#define ACC 1
+#define IMM 2
+#define ZP 3
+#define ZPX 4
+#define ZPY 5
+#define REL 6
+#define ABS 7
+#define ABSX 8
+#define ABSY 9
+#define IND 10
+#define INDX 11
+#define INDY 12
+
+// Undocumented opcodes are shown as ??? and take one byte
+static const char *mnemonics[256] = {
+/*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  | */
+/* 0 */ "BRK", "ORA", "???", "???", "???", "ORA", "ASL", "???", "PHP", "ORA", "ASL", "???", "???", "ORA", "ASL", "???",
+/* 1 */ "BPL", "ORA", "???", "???", "???", "ORA", "ASL", "???", "CLC", "ORA", "???", "???", "???", "ORA", "ASL", "???",
+/* 2 */ "JSR", "AND", "???", "???", "BIT", "AND", "ROL", "???", "PLP", "AND", "ROL", "???", "BIT", "AND", "ROL", "???",
+/* 3 */ "BMI", "AND", "???", "???", "???", "AND", "ROL", "???", "SEC", "AND", "???", "???", "???", "AND", "ROL", "???",
+/* 4 */ "RTI", "EOR", "???", "???", "???", "EOR", "LSR", "???", "PHA", "EOR", "LSR", "???", "JMP", "EOR", "LSR", "???",
+/* 5 */ "BVC", "EOR", "???", "???", "???", "EOR", "LSR", "???", "CLI", "EOR", "???", "???", "???", "EOR", "LSR", "???",
+/* 6 */ "RTS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "PLA", "ADC", "ROR", "???", "JMP", "ADC", "ROR", "???",
+/* 7 */ "BVS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "SEI", "ADC", "???", "???", "???", "ADC", "ROR", "???",
+/* 8 */ "???", "STA", "???", "???", "STY", "STA", "STX", "???", "DEY", "???", "TXA", "???", "STY", "STA", "STX", "???",
+/* 9 */ "BCC", "STA", "???", "???", "STY", "STA", "STX", "???", "TYA", "STA", "TXS", "???", "???", "STA", "???", "???",
+/* A */ "LDY", "LDA", "LDX", "???", "LDY", "LDA", "LDX", "???", "TAY", "LDA", "TAX", "???", "LDY", "LDA", "LDX", "???",
+/* B */ "BCS", "LDA", "???", "???", "LDY", "LDA", "LDX", "???", "CLV", "LDA", "TSX", "???", "LDY", "LDA", "LDX", "???",
+/* C */ "CPY", "CMP", "???", "???", "CPY", "CMP", "DEC", "???", "INY", "CMP", "DEX", "???", "CPY", "CMP", "DEC", "???",
+/* D */ "BNE", "CMP", "???", "???", "???", "CMP", "DEC", "???", "CLD", "CMP", "???", "???", "???", "CMP", "DEC", "???",
+/* E */ "CPX", "SBC", "???", "???", "CPX", "SBC", "INC", "???", "INX", "SBC", "NOP", "???", "CPX", "SBC", "INC", "???",
+/* F */ "BEQ", "SBC", "???", "???", "???", "SBC", "INC", "???", "SED", "SBC", "???", "???", "???", "SBC", "INC", "???"
+};
+
+static const uint8_t modes[256] = {
+/*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  | */
+/* 0 */  IMP, INDX,  IMP,  IMP,  IMP,   ZP,   ZP,  IMP,  IMP,  IMM,  ACC,  IMP,  IMP,  ABS,  ABS,  IMP,
+/* 1 */  REL, INDY,  IMP,  IMP,  IMP,  ZPX,  ZPX,  IMP,  IMP, ABSY,  IMP,  IMP,  IMP, ABSX, ABSX,  IMP,
+/* 2 */  ABS, INDX,  IMP,  IMP,   ZP,   ZP,   ZP,  IMP,  IMP,  IMM,  ACC,  IMP,  ABS,  ABS,  ABS,  IMP,
+/* 3 */  REL, INDY,  IMP,  IMP,  IMP,  ZPX,  ZPX,  IMP,  IMP, ABSY,  IMP,  IMP,  IMP, ABSX, ABSX,  IMP,
+/* 4 */  IMP, INDX,  IMP,  IMP,  IMP,   ZP,   ZP,  IMP,  IMP,  IMM,  ACC,  IMP,  ABS,  ABS,  ABS,  IMP,
+/* 5 */  REL, INDY,  IMP,  IMP,  IMP,  ZPX,  ZPX,  IMP,  IMP, ABSY,  IMP,  IMP,  IMP, ABSX, ABSX,  IMP,
+/* 6 */  IMP, INDX,  IMP,  IMP,  IMP,   ZP,   ZP,  IMP,  IMP,  IMM,  ACC,  IMP,  IND,  ABS,  ABS,  IMP,
+/* 7 */  REL, INDY,  IMP,  IMP,  IMP,  ZPX,  ZPX,  IMP,  IMP, ABSY,  IMP,  IMP,  IMP, ABSX, ABSX,  IMP,
+/* 8 */  IMP, INDX,  IMP,  IMP,   ZP,   ZP,   ZP,  IMP,  IMP,  IMP,  IMP,  IMP,  ABS,  ABS,  ABS,  IMP,
+/* 9 */  REL, INDY,  IMP,  IMP,  ZPX,  ZPX,  ZPY,  IMP,  IMP, ABSY,  IMP,  IMP,  IMP, ABSX,  IMP,  IMP,
+/* A */  IMM, INDX,  IMM,  IMP,   ZP,   ZP,   ZP,  IMP,  IMP,  IMM,  IMP,  IMP,  ABS,  ABS,  ABS,  IMP,
+/* B */  REL, INDY,  IMP,  IMP,  ZPX,  ZPX,  ZPY,  IMP,  IMP, ABSY,  IMP,  IMP, ABSX, ABSX, ABSY,  IMP,
+/* C */  IMM, INDX,  IMP,  IMP,   ZP,   ZP,   ZP,  IMP,  IMP,  IMM,  IMP,  IMP,  ABS,  ABS,  ABS,  IMP,
+/* D */  REL, INDY,  IMP,  IMP,  IMP,  ZPX,  ZPX,  IMP,  IMP, ABSY,  IMP,  IMP,  IMP, ABSX, ABSX,  IMP,
+/* E */  IMM, INDX,  IMP,  IMP,   ZP,   ZP,   ZP,  IMP,  IMP,  IMM,  IMP,  IMP,  ABS,  ABS,  ABS,  IMP,
+/* F */  REL, INDY,  IMP,  IMP,  IMP,  ZPX,  ZPX,  IMP,  IMP, ABSY,  IMP,  IMP,  IMP, ABSX, ABSX,  IMP
+};
+
+static const int mode_length[13] = { 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2 };
+
+int disasm6502_length(uint8_t opcode) {
+    return mode_length[modes[opcode]];
+}
+
+/* Whether the opcode's addressing mode has an effective address */
+int disasm6502_has_ea(uint8_t opcode) {
+    return (modes[opcode] != IMP) && (modes[opcode] != ACC) &&
+        (modes[opcode] != IMM) && (modes[opcode] != REL);
+}
+
+/* Disassemble the instruction at addr, whose bytes (up to 3) are given,
+ * into out as the hex bytes followed by the instruction. Returns the
+ * length of the instruction. */
+int disasm6502(uint16_t addr, uint8_t *bytes, char *out, int size) {
+    uint8_t op = bytes[0];
+    uint16_t abs = bytes[1] | (bytes[2] << 8);
+    int len = mode_length[modes[op]];
+    char hex[16], operand[16];
+
+    if (len == 1) {
+        snprintf(hex, sizeof(hex), "%02X", op);
+    } else if (len == 2) {
+        snprintf(hex, sizeof(hex), "%02X %02X", op, bytes[1]);
+    } else {
+        snprintf(hex, sizeof(hex), "%02X %02X %02X", op, bytes[1], bytes[2]);
+    }
+
+    switch (modes[op]) {
+        case IMP: operand[0] = 0; break;
+        case ACC: snprintf(operand, sizeof(operand), "A"); break;
+        case IMM: snprintf(operand, sizeof(operand), "#$%02X", bytes[1]); break;
+        case ZP: snprintf(operand, sizeof(operand), "$%02X", bytes[1]); break;
+        case ZPX: snprintf(operand, sizeof(operand), "$%02X,X", bytes[1]); break;
+        case ZPY: snprintf(operand, sizeof(operand), "$%02X,Y", bytes[1]); break;
+        case REL: snprintf(operand, sizeof(operand), "$%04X", (uint16_t) (addr + 2 + (int8_t) bytes[1])); break;
+        case ABS: snprintf(operand, sizeof(operand), "$%04X", abs); break;
+        case ABSX: snprintf(operand, sizeof(operand), "$%04X,X", abs); break;
+        case ABSY: snprintf(operand, sizeof(operand), "$%04X,Y", abs); break;
+        case IND: snprintf(operand, sizeof(operand), "($%04X)", abs); break;
+        case INDX: snprintf(operand, sizeof(operand), "($%02X,X)", bytes[1]); break;
+        case INDY: snprintf(operand, sizeof(operand), "($%02X),Y", bytes[1]); break;
+    }
+    if (operand[0]) {
+        snprintf(out, size, "%-9s %s %s", hex, mnemonics[op], operand);
+    } else {
+        snprintf(out, size, "%-9s %s", hex, mnemonics[op]);
+    }
+    return len;
+}
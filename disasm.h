@@ -0,0 +1,11 @@
+/* A 6502 disassembler for the profiler and debugger reports */
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+
+int disasm6502(uint16_t addr, uint8_t *bytes, char *out, int size);
+int disasm6502_length(uint8_t opcode);
+int disasm6502_has_ea(uint8_t opcode);
+
+#endif
@@ -46,14 +46,24 @@
  * Fake6502 requires you to provide two external     *
  * functions:                                        *
  *                                                   *
- * uint8_t read6502(uint16_t address)                *
- * void write6502(uint16_t address, uint8_t value)   *
+ * uint8_t read6502(CPU6502 *c, uint16_t address)    *
+ * void write6502(CPU6502 *c, uint16_t address,      *
+ *                uint8_t value)                     *
+ *                                                   *
+ * The host can also point readmap/writemap entries *
+ * at 256-byte pages of plain memory. Those pages    *
+ * are accessed directly and the callbacks are only  *
+ * used for pages left NULL.                         *
+ *                                                   *
+ * All CPU state lives in the CPU6502 struct from    *
+ * fake6502.h, and every function takes a pointer to *
+ * the CPU it works on, so several CPUs can run in   *
+ * the same process.                                 *
  *                                                   *
  * You may optionally pass Fake6502 the pointer to a *
  * function which you want to be called after every  *
  * emulated instruction. This function should be a   *
- * void with no parameters expected to be passed to  *
- * it.                                               *
+ * void taking the CPU6502 pointer.                  *
  *                                                   *
  * This can be very useful. For example, in a NES    *
  * emulator, you check the number of clock ticks     *
@@ -61,36 +71,43 @@
  * APU events.                                       *
  *                                                   *
  * To pass Fake6502 this pointer, use the            *
- * hookexternal(void *funcptr) function provided.    *
+ * hookexternal(c, void *funcptr) function provided. *
  *                                                   *
  * To disable the hook later, pass NULL to it.       *
  *****************************************************
  * Useful functions in this emulator:                *
  *                                                   *
- * void reset6502()                                  *
+ * void reset6502(CPU6502 *c)                        *
  *   - Call this once before you begin execution.    *
  *                                                   *
- * void exec6502(uint32_t tickcount)                 *
+ * void exec6502(CPU6502 *c, uint32_t tickcount)     *
  *   - Execute 6502 code up to the next specified    *
  *     count of clock ticks.                         *
  *                                                   *
- * void step6502()                                   *
+ * void step6502(CPU6502 *c)                         *
  *   - Execute a single instrution.                  *
  *                                                   *
- * void irq6502()                                    *
+ * void irq6502(CPU6502 *c)                          *
  *   - Trigger a hardware IRQ in the 6502 core.      *
  *                                                   *
- * void nmi6502()                                    *
+ * void nmi6502(CPU6502 *c)                          *
  *   - Trigger an NMI in the 6502 core.              *
  *                                                   *
- * void hookexternal(void *funcptr)                  *
- *   - Pass a pointer to a void function taking no   *
- *     parameters. This will cause Fake6502 to call  *
+ * void status6502(CPU6502 *c)                       *
+ *   - Bring the N and Z flags in status up to date. *
+ *     The core leaves them out while it runs, so a  *
+ *     hook or memory callback must call this before *
+ *     it reads or writes status. Once exec6502 or   *
+ *     step6502 returns, status is up to date.       *
+ *                                                   *
+ * void hookexternal(CPU6502 *c, void *funcptr)      *
+ *   - Pass a pointer to a void function taking the  *
+ *     CPU pointer. This will cause Fake6502 to call *
  *     that function once after each emulated        *
  *     instruction.                                  *
  *                                                   *
  *****************************************************
- * Useful variables in this emulator:                *
+ * Useful variables in the CPU6502 struct:           *
  *                                                   *
  * uint32_t clockticks6502                           *
  *   - A running total of the emulated cycle count.  *
@@ -104,6 +121,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include "fake6502.h"
 
 //6502 defines
 #undef UNDOCUMENTED //when this is defined, undocumented opcodes are handled.
@@ -114,33 +132,46 @@
                      //CPU in the Nintendo Entertainment System does not
                      //support BCD operation.
 
-#define FLAG_CARRY     0x01
-#define FLAG_ZERO      0x02
-#define FLAG_INTERRUPT 0x04
-#define FLAG_DECIMAL   0x08
-#define FLAG_BREAK     0x10
-#define FLAG_CONSTANT  0x20
-#define FLAG_OVERFLOW  0x40
-#define FLAG_SIGN      0x80
+                     //TABLE_CORE (set from the Makefile, not here) builds the
+                     //original addrtable/optable dispatch instead of the fused
+                     //switch. it is kept as a reference for checking and
+                     //benchmarking the fused core.
+
+#ifndef TABLE_CORE
+#define LAZY_FLAGS          //the fused core works out N and Z only when they
+                            //are looked at, see nzcalc below. the table core
+                            //still sets them on every instruction, so the two
+                            //can be checked against each other.
+#endif
+
+//the fused core has every addressing mode and instruction handler inlined
+//into its one switch in exec6502, so a case is the whole instruction with
+//no calls left in it. the table core needs them as real functions to put
+//in its tables.
+#ifdef TABLE_CORE
+#define HANDLER static
+#else
+#define HANDLER static inline __attribute__((always_inline))
+#endif
 
 #define BASE_STACK     0x100
 
-#define saveaccum(n) a = (uint8_t)((n) & 0x00FF)
+#define saveaccum(n) c->a = (uint8_t)((n) & 0x00FF)
 
 
 //flag modifier macros
-#define setcarry() status |= FLAG_CARRY
-#define clearcarry() status &= (~FLAG_CARRY)
-#define setzero() status |= FLAG_ZERO
-#define clearzero() status &= (~FLAG_ZERO)
-#define setinterrupt() status |= FLAG_INTERRUPT
-#define clearinterrupt() status &= (~FLAG_INTERRUPT)
-#define setdecimal() status |= FLAG_DECIMAL
-#define cleardecimal() status &= (~FLAG_DECIMAL)
-#define setoverflow() status |= FLAG_OVERFLOW
-#define clearoverflow() status &= (~FLAG_OVERFLOW)
-#define setsign() status |= FLAG_SIGN
-#define clearsign() status &= (~FLAG_SIGN)
+#define setcarry() c->status |= FLAG_CARRY
+#define clearcarry() c->status &= (~FLAG_CARRY)
+#define setzero() c->status |= FLAG_ZERO
+#define clearzero() c->status &= (~FLAG_ZERO)
+#define setinterrupt() c->status |= FLAG_INTERRUPT
+#define clearinterrupt() c->status &= (~FLAG_INTERRUPT)
+#define setdecimal() c->status |= FLAG_DECIMAL
+#define cleardecimal() c->status &= (~FLAG_DECIMAL)
+#define setoverflow() c->status |= FLAG_OVERFLOW
+#define clearoverflow() c->status &= (~FLAG_OVERFLOW)
+#define setsign() c->status |= FLAG_SIGN
+#define clearsign() c->status &= (~FLAG_SIGN)
 
 
 //flag calculation macros
@@ -164,674 +195,738 @@
         else clearoverflow();\
 }
 
+//N and Z together, from the same value. with LAZY_FLAGS the value is only
+//kept in nzresult, and status isn't touched until a branch, PHP, BRK or an
+//interrupt needs them, or the host calls status6502(). most are overwritten
+//by the next instruction long before that.
+#ifdef LAZY_FLAGS
+#define nzcalc(n) {\
+    c->nzresult = (uint8_t)(n);\
+    c->lazynz = 1;\
+}
+#define zeroflag() (c->lazynz ? c->nzresult == 0 : (c->status & FLAG_ZERO) != 0)
+#define signflag() (c->lazynz ? (c->nzresult & 0x80) != 0 : (c->status & FLAG_SIGN) != 0)
+#else
+#define nzcalc(n) {\
+    zerocalc(n);\
+    signcalc(n);\
+}
+#define zeroflag() ((c->status & FLAG_ZERO) != 0)
+#define signflag() ((c->status & FLAG_SIGN) != 0)
+#endif
+
 
-//6502 CPU registers
-uint16_t pc;
-uint8_t sp, a, x, y, status;
+//decimal mode ADC and SBC, done a digit at a time the way the NMOS 6502
+//does it. each table is indexed by the carry into a digit in bit 8, the
+//accumulator's digit in bits 4-7 and the operand's in bits 0-3, and gives
+//the adjusted digit in bits 0-3 and the carry out of it in bit 4. the low
+//digits are looked up first and their carry picks the entry for the high
+//digits. for ADC the high digit's entry also holds N and V in its high
+//byte, taken from the digits' sum before it is adjusted, as the NMOS part
+//does. Z comes from the binary sum, and SBC takes all its flags from the
+//binary subtraction. the tables are built here at compile time.
+#ifndef NES_CPU
+#define NIBSUM(i) ((((i) >> 4) & 0x0F) + ((i) & 0x0F) + ((i) >> 8))
+#define NIBDIFF(i) ((((i) >> 4) & 0x0F) - ((i) & 0x0F) - 1 + ((i) >> 8))
+#define NIBOVERFLOW(i) ((((i) >> 4) ^ NIBSUM(i)) & ((i) ^ NIBSUM(i)) & 0x08 ? FLAG_OVERFLOW << 8 : 0)
+#define NIBSIGN(i) (NIBSUM(i) & 0x08 ? FLAG_SIGN << 8 : 0)
+#define BCDADC(i) ((NIBSUM(i) > 0x09 ? ((NIBSUM(i) + 0x06) & 0x0F) | 0x10 : NIBSUM(i)) | NIBSIGN(i) | NIBOVERFLOW(i))
+#define BCDSBC(i) (NIBDIFF(i) < 0 ? (NIBDIFF(i) - 0x06) & 0x0F : NIBDIFF(i) | 0x10)
+#define BCD4(f, r) f(r), f((r) + 1), f((r) + 2), f((r) + 3)
+#define BCD16(f, r) BCD4(f, r), BCD4(f, (r) + 4), BCD4(f, (r) + 8), BCD4(f, (r) + 12)
+#define BCD64(f, r) BCD16(f, r), BCD16(f, (r) + 16), BCD16(f, (r) + 32), BCD16(f, (r) + 48)
+#define BCD256(f, r) BCD64(f, r), BCD64(f, (r) + 64), BCD64(f, (r) + 128), BCD64(f, (r) + 192)
+#define BCD512(f) BCD256(f, 0), BCD256(f, 256)
+
+static const uint16_t bcdadc[512] = { BCD512(BCDADC) };
+static const uint8_t bcdsbc[512] = { BCD512(BCDSBC) };
+
+#define BCDLOW(a, v, carry) ((((a) & 0x0F) << 4) | ((v) & 0x0F) | ((carry) << 8))
+#define BCDHIGH(a, v, low) (((a) & 0xF0) | ((v) >> 4) | (((low) & 0x10) << 4))
+#endif
 
 
-//helper variables
-uint32_t instructions = 0; //keep track of total instructions executed
-uint32_t clockticks6502 = 0, clockgoal6502 = 0;
-uint16_t oldpc, ea, reladdr, value, result;
-uint8_t opcode, oldstatus;
+//memory access goes straight to the page when the host has mapped it in
+//readmap/writemap, and only falls back to the read6502/write6502 callbacks
+//for unmapped pages such as memory-mapped I/O
+static inline __attribute__((always_inline)) uint8_t memread(CPU6502 *c, uint16_t address) {
+    uint8_t *page = c->readmap[address >> 8];
+    if (page) return page[address & 0xFF];
+    return read6502(c, address);
+}
 
-//externally supplied functions
-extern uint8_t read6502(uint16_t address);
-extern void write6502(uint16_t address, uint8_t value);
+static inline __attribute__((always_inline)) void memwrite(CPU6502 *c, uint16_t address, uint8_t value) {
+    uint8_t *page = c->writemap[address >> 8];
+    if (page) page[address & 0xFF] = value;
+        else write6502(c, address, value);
+}
 
 //a few general functions used by various other functions
-void push16(uint16_t pushval) {
-    write6502(BASE_STACK + sp, (pushval >> 8) & 0xFF);
-    write6502(BASE_STACK + ((sp - 1) & 0xFF), pushval & 0xFF);
-    sp -= 2;
+HANDLER void push16(CPU6502 *c, uint16_t pushval) {
+    memwrite(c, BASE_STACK + c->sp, (pushval >> 8) & 0xFF);
+    memwrite(c, BASE_STACK + ((c->sp - 1) & 0xFF), pushval & 0xFF);
+    c->sp -= 2;
 }
 
-void push8(uint8_t pushval) {
-    write6502(BASE_STACK + sp--, pushval);
+HANDLER void push8(CPU6502 *c, uint8_t pushval) {
+    memwrite(c, BASE_STACK + c->sp--, pushval);
 }
 
-uint16_t pull16() {
+HANDLER uint16_t pull16(CPU6502 *c) {
     uint16_t temp16;
-    temp16 = read6502(BASE_STACK + ((sp + 1) & 0xFF)) | ((uint16_t)read6502(BASE_STACK + ((sp + 2) & 0xFF)) << 8);
-    sp += 2;
+    temp16 = memread(c, BASE_STACK + ((c->sp + 1) & 0xFF)) | ((uint16_t)memread(c, BASE_STACK + ((c->sp + 2) & 0xFF)) << 8);
+    c->sp += 2;
     return(temp16);
 }
 
-uint8_t pull8() {
-    return (read6502(BASE_STACK + ++sp));
+HANDLER uint8_t pull8(CPU6502 *c) {
+    return (memread(c, BASE_STACK + ++c->sp));
 }
 
-void reset6502() {
-    pc = (uint16_t)read6502(0xFFFC) | ((uint16_t)read6502(0xFFFD) << 8);
-    a = 0;
-    x = 0;
-    y = 0;
-    sp = 0xFD;
-    status |= FLAG_CONSTANT;
+//bring N and Z in status up to date, and keep them there until the next
+//instruction that sets them
+void status6502(CPU6502 *c) {
+    if (c->lazynz) {
+        c->status = (c->status & ~(FLAG_ZERO | FLAG_SIGN)) | (c->nzresult & FLAG_SIGN) | (c->nzresult ? 0 : FLAG_ZERO);
+        c->lazynz = 0;
+    }
 }
 
+void reset6502(CPU6502 *c) {
+    c->pc = (uint16_t)memread(c, 0xFFFC) | ((uint16_t)memread(c, 0xFFFD) << 8);
+    c->a = 0;
+    c->x = 0;
+    c->y = 0;
+    c->sp = 0xFD;
+    c->status |= FLAG_CONSTANT;
+}
 
-static void (*addrtable[256])();
-static void (*optable[256])();
-uint8_t penaltyop, penaltyaddr;
 
 //addressing mode functions, calculates effective addresses
-static void imp() { //implied
+HANDLER void imp(CPU6502 *c) { //implied
 }
 
-static void acc() { //accumulator
+HANDLER void acc(CPU6502 *c) { //accumulator
 }
 
-static void imm() { //immediate
-    ea = pc++;
+HANDLER void imm(CPU6502 *c) { //immediate
+    c->ea = c->pc++;
 }
 
-static void zp() { //zero-page
-    ea = (uint16_t)read6502((uint16_t)pc++);
+HANDLER void zp(CPU6502 *c) { //zero-page
+    c->ea = (uint16_t)memread(c, (uint16_t)c->pc++);
 }
 
-static void zpx() { //zero-page,X
-    ea = ((uint16_t)read6502((uint16_t)pc++) + (uint16_t)x) & 0xFF; //zero-page wraparound
+HANDLER void zpx(CPU6502 *c) { //zero-page,X
+    c->ea = ((uint16_t)memread(c, (uint16_t)c->pc++) + (uint16_t)c->x) & 0xFF; //zero-page wraparound
 }
 
-static void zpy() { //zero-page,Y
-    ea = ((uint16_t)read6502((uint16_t)pc++) + (uint16_t)y) & 0xFF; //zero-page wraparound
+HANDLER void zpy(CPU6502 *c) { //zero-page,Y
+    c->ea = ((uint16_t)memread(c, (uint16_t)c->pc++) + (uint16_t)c->y) & 0xFF; //zero-page wraparound
 }
 
-static void rel() { //relative for branch ops (8-bit immediate value, sign-extended)
-    reladdr = (uint16_t)read6502(pc++);
-    if (reladdr & 0x80) reladdr |= 0xFF00;
+HANDLER void rel(CPU6502 *c) { //relative for branch ops (8-bit immediate value, sign-extended)
+    c->reladdr = (uint16_t)memread(c, c->pc++);
+    if (c->reladdr & 0x80) c->reladdr |= 0xFF00;
 }
 
-static void abso() { //absolute
-    ea = (uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8);
-    pc += 2;
+HANDLER void abso(CPU6502 *c) { //absolute
+    c->ea = (uint16_t)memread(c, c->pc) | ((uint16_t)memread(c, c->pc+1) << 8);
+    c->pc += 2;
 }
 
-static void absx() { //absolute,X
+HANDLER void absx(CPU6502 *c) { //absolute,X
     uint16_t startpage;
-    ea = ((uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8));
-    startpage = ea & 0xFF00;
-    ea += (uint16_t)x;
+    c->ea = ((uint16_t)memread(c, c->pc) | ((uint16_t)memread(c, c->pc+1) << 8));
+    startpage = c->ea & 0xFF00;
+    c->ea += (uint16_t)c->x;
 
-    if (startpage != (ea & 0xFF00)) { //one cycle penlty for page-crossing on some opcodes
-        penaltyaddr = 1;
+    if (startpage != (c->ea & 0xFF00)) { //one cycle penlty for page-crossing on some opcodes
+        c->penaltyaddr = 1;
     }
 
-    pc += 2;
+    c->pc += 2;
 }
 
-static void absy() { //absolute,Y
+HANDLER void absy(CPU6502 *c) { //absolute,Y
     uint16_t startpage;
-    ea = ((uint16_t)read6502(pc) | ((uint16_t)read6502(pc+1) << 8));
-    startpage = ea & 0xFF00;
-    ea += (uint16_t)y;
+    c->ea = ((uint16_t)memread(c, c->pc) | ((uint16_t)memread(c, c->pc+1) << 8));
+    startpage = c->ea & 0xFF00;
+    c->ea += (uint16_t)c->y;
 
-    if (startpage != (ea & 0xFF00)) { //one cycle penlty for page-crossing on some opcodes
-        penaltyaddr = 1;
+    if (startpage != (c->ea & 0xFF00)) { //one cycle penlty for page-crossing on some opcodes
+        c->penaltyaddr = 1;
     }
 
-    pc += 2;
+    c->pc += 2;
 }
 
-static void ind() { //indirect
+HANDLER void ind(CPU6502 *c) { //indirect
     uint16_t eahelp, eahelp2;
-    eahelp = (uint16_t)read6502(pc) | (uint16_t)((uint16_t)read6502(pc+1) << 8);
+    eahelp = (uint16_t)memread(c, c->pc) | (uint16_t)((uint16_t)memread(c, c->pc+1) << 8);
     eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); //replicate 6502 page-boundary wraparound bug
-    ea = (uint16_t)read6502(eahelp) | ((uint16_t)read6502(eahelp2) << 8);
-    pc += 2;
+    c->ea = (uint16_t)memread(c, eahelp) | ((uint16_t)memread(c, eahelp2) << 8);
+    c->pc += 2;
 }
 
-static void indx() { // (indirect,X)
+HANDLER void indx(CPU6502 *c) { // (indirect,X)
     uint16_t eahelp;
-    eahelp = (uint16_t)(((uint16_t)read6502(pc++) + (uint16_t)x) & 0xFF); //zero-page wraparound for table pointer
-    ea = (uint16_t)read6502(eahelp & 0x00FF) | ((uint16_t)read6502((eahelp+1) & 0x00FF) << 8);
+    eahelp = (uint16_t)(((uint16_t)memread(c, c->pc++) + (uint16_t)c->x) & 0xFF); //zero-page wraparound for table pointer
+    c->ea = (uint16_t)memread(c, eahelp & 0x00FF) | ((uint16_t)memread(c, (eahelp+1) & 0x00FF) << 8);
 }
 
-static void indy() { // (indirect),Y
+HANDLER void indy(CPU6502 *c) { // (indirect),Y
     uint16_t eahelp, eahelp2, startpage;
-    eahelp = (uint16_t)read6502(pc++);
+    eahelp = (uint16_t)memread(c, c->pc++);
     eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); //zero-page wraparound
-    ea = (uint16_t)read6502(eahelp) | ((uint16_t)read6502(eahelp2) << 8);
-    startpage = ea & 0xFF00;
-    ea += (uint16_t)y;
+    c->ea = (uint16_t)memread(c, eahelp) | ((uint16_t)memread(c, eahelp2) << 8);
+    startpage = c->ea & 0xFF00;
+    c->ea += (uint16_t)c->y;
 
-    if (startpage != (ea & 0xFF00)) { //one cycle penlty for page-crossing on some opcodes
-        penaltyaddr = 1;
+    if (startpage != (c->ea & 0xFF00)) { //one cycle penlty for page-crossing on some opcodes
+        c->penaltyaddr = 1;
     }
 }
 
-static uint16_t getvalue() {
-    if (addrtable[opcode] == acc) return((uint16_t)a);
-        else return((uint16_t)read6502(ea));
+//only the four accumulator shifts (0x0A, 0x2A, 0x4A, 0x6A) operate on A, and they
+//have their own handlers below, so every other operand comes from memory
+HANDLER uint16_t getvalue(CPU6502 *c) {
+    return((uint16_t)memread(c, c->ea));
 }
 
-static uint16_t getvalue16() {
-    return((uint16_t)read6502(ea) | ((uint16_t)read6502(ea+1) << 8));
+HANDLER uint16_t getvalue16(CPU6502 *c) {
+    return((uint16_t)memread(c, c->ea) | ((uint16_t)memread(c, c->ea+1) << 8));
 }
 
-static void putvalue(uint16_t saveval) {
-    if (addrtable[opcode] == acc) a = (uint8_t)(saveval & 0x00FF);
-        else write6502(ea, (saveval & 0x00FF));
+HANDLER void putvalue(CPU6502 *c, uint16_t saveval) {
+    memwrite(c, c->ea, (saveval & 0x00FF));
 }
 
 
 //instruction handler functions
-static void adc() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
-   
-    carrycalc(result);
-    zerocalc(result);
-    overflowcalc(result, a, value);
-    signcalc(result);
+HANDLER void adc(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->a + c->value + (uint16_t)(c->status & FLAG_CARRY);
     
     #ifndef NES_CPU
-    if (status & FLAG_DECIMAL) {
-        clearcarry();
-        
-        if ((result & 0x0F) > 0x09) {
-            result += 0x06;
-        }
-        if ((result & 0xF0) > 0x90) {
-            result += 0x60;
-            setcarry();
-        }
-        
-        clockticks6502++;
+    if (c->status & FLAG_DECIMAL) {
+        uint16_t low = bcdadc[BCDLOW(c->a, c->value, c->status & FLAG_CARRY)];
+        uint16_t high = bcdadc[BCDHIGH(c->a, c->value, low)];
+
+        c->status = (c->status & ~(FLAG_CARRY | FLAG_ZERO | FLAG_OVERFLOW | FLAG_SIGN)) |
+            ((high >> 4) & FLAG_CARRY) | (high >> 8) | ((c->result & 0xFF) ? 0 : FLAG_ZERO);
+        c->lazynz = 0;
+        c->clockticks6502++;
+        saveaccum(((high & 0x0F) << 4) | (low & 0x0F));
+        return;
     }
     #endif
    
-    saveaccum(result);
+    carrycalc(c->result);
+    nzcalc(c->result);
+    overflowcalc(c->result, c->a, c->value);
+   
+    saveaccum(c->result);
 }
 
-static void and() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (uint16_t)a & value;
+HANDLER void and(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->a & c->value;
    
-    zerocalc(result);
-    signcalc(result);
+    nzcalc(c->result);
    
-    saveaccum(result);
+    saveaccum(c->result);
 }
 
-static void asl() {
-    value = getvalue();
-    result = value << 1;
+HANDLER void asl(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = c->value << 1;
 
-    carrycalc(result);
-    zerocalc(result);
-    signcalc(result);
+    carrycalc(c->result);
+    nzcalc(c->result);
    
-    putvalue(result);
+    putvalue(c, c->result);
 }
 
-static void bcc() {
-    if ((status & FLAG_CARRY) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void asla(CPU6502 *c) {
+    c->value = (uint16_t)c->a;
+    c->result = c->value << 1;
+
+    carrycalc(c->result);
+    nzcalc(c->result);
+
+    saveaccum(c->result);
+}
+
+HANDLER void bcc(CPU6502 *c) {
+    if ((c->status & FLAG_CARRY) == 0) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void bcs() {
-    if ((status & FLAG_CARRY) == FLAG_CARRY) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void bcs(CPU6502 *c) {
+    if ((c->status & FLAG_CARRY) == FLAG_CARRY) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void beq() {
-    if ((status & FLAG_ZERO) == FLAG_ZERO) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void beq(CPU6502 *c) {
+    if (zeroflag()) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void bit() {
-    value = getvalue();
-    result = (uint16_t)a & value;
+HANDLER void bit(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->a & c->value;
    
-    zerocalc(result);
-    status = (status & 0x3F) | (uint8_t)(value & 0xC0);
+    c->status = (c->status & 0x3D) | (uint8_t)(c->value & 0xC0) | ((c->result & 0xFF) ? 0 : FLAG_ZERO);
+    c->lazynz = 0;
 }
 
-static void bmi() {
-    if ((status & FLAG_SIGN) == FLAG_SIGN) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void bmi(CPU6502 *c) {
+    if (signflag()) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void bne() {
-    if ((status & FLAG_ZERO) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void bne(CPU6502 *c) {
+    if (!zeroflag()) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void bpl() {
-    if ((status & FLAG_SIGN) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void bpl(CPU6502 *c) {
+    if (!signflag()) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void brk() {
-    pc++;
-    push16(pc); //push next instruction address onto stack
-    push8(status | FLAG_BREAK); //push CPU status to stack
+HANDLER void brk(CPU6502 *c) {
+    c->pc++;
+    push16(c, c->pc); //push next instruction address onto stack
+    status6502(c);
+    push8(c, c->status | FLAG_BREAK); //push CPU status to stack
     setinterrupt(); //set interrupt flag
-    pc = (uint16_t)read6502(0xFFFE) | ((uint16_t)read6502(0xFFFF) << 8);
+    c->pc = (uint16_t)memread(c, 0xFFFE) | ((uint16_t)memread(c, 0xFFFF) << 8);
 }
 
-static void bvc() {
-    if ((status & FLAG_OVERFLOW) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void bvc(CPU6502 *c) {
+    if ((c->status & FLAG_OVERFLOW) == 0) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void bvs() {
-    if ((status & FLAG_OVERFLOW) == FLAG_OVERFLOW) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; //check if jump crossed a page boundary
-            else clockticks6502++;
+HANDLER void bvs(CPU6502 *c) {
+    if ((c->status & FLAG_OVERFLOW) == FLAG_OVERFLOW) {
+        c->oldpc = c->pc;
+        c->pc += c->reladdr;
+        if ((c->oldpc & 0xFF00) != (c->pc & 0xFF00)) c->clockticks6502 += 2; //check if jump crossed a page boundary
+            else c->clockticks6502++;
     }
 }
 
-static void clc() {
+HANDLER void clc(CPU6502 *c) {
     clearcarry();
 }
 
-static void cld() {
+HANDLER void cld(CPU6502 *c) {
     cleardecimal();
 }
 
-static void cli() {
+HANDLER void cli(CPU6502 *c) {
     clearinterrupt();
 }
 
-static void clv() {
+HANDLER void clv(CPU6502 *c) {
     clearoverflow();
 }
 
-static void cmp() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (uint16_t)a - value;
+HANDLER void cmp(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->a - c->value;
    
-    if (a >= (uint8_t)(value & 0x00FF)) setcarry();
+    if (c->a >= (uint8_t)(c->value & 0x00FF)) setcarry();
         else clearcarry();
-    if (a == (uint8_t)(value & 0x00FF)) setzero();
-        else clearzero();
-    signcalc(result);
+    nzcalc(c->result);
 }
 
-static void cpx() {
-    value = getvalue();
-    result = (uint16_t)x - value;
+HANDLER void cpx(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->x - c->value;
    
-    if (x >= (uint8_t)(value & 0x00FF)) setcarry();
+    if (c->x >= (uint8_t)(c->value & 0x00FF)) setcarry();
         else clearcarry();
-    if (x == (uint8_t)(value & 0x00FF)) setzero();
-        else clearzero();
-    signcalc(result);
+    nzcalc(c->result);
 }
 
-static void cpy() {
-    value = getvalue();
-    result = (uint16_t)y - value;
+HANDLER void cpy(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->y - c->value;
    
-    if (y >= (uint8_t)(value & 0x00FF)) setcarry();
+    if (c->y >= (uint8_t)(c->value & 0x00FF)) setcarry();
         else clearcarry();
-    if (y == (uint8_t)(value & 0x00FF)) setzero();
-        else clearzero();
-    signcalc(result);
+    nzcalc(c->result);
 }
 
-static void dec() {
-    value = getvalue();
-    result = value - 1;
+HANDLER void dec(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = c->value - 1;
    
-    zerocalc(result);
-    signcalc(result);
+    nzcalc(c->result);
    
-    putvalue(result);
+    putvalue(c, c->result);
 }
 
-static void dex() {
-    x--;
+HANDLER void dex(CPU6502 *c) {
+    c->x--;
    
-    zerocalc(x);
-    signcalc(x);
+    nzcalc(c->x);
 }
 
-static void dey() {
-    y--;
+HANDLER void dey(CPU6502 *c) {
+    c->y--;
    
-    zerocalc(y);
-    signcalc(y);
+    nzcalc(c->y);
 }
 
-static void eor() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (uint16_t)a ^ value;
+HANDLER void eor(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->a ^ c->value;
    
-    zerocalc(result);
-    signcalc(result);
+    nzcalc(c->result);
    
-    saveaccum(result);
+    saveaccum(c->result);
 }
 
-static void inc() {
-    value = getvalue();
-    result = value + 1;
+HANDLER void inc(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = c->value + 1;
    
-    zerocalc(result);
-    signcalc(result);
+    nzcalc(c->result);
    
-    putvalue(result);
+    putvalue(c, c->result);
 }
 
-static void inx() {
-    x++;
+HANDLER void inx(CPU6502 *c) {
+    c->x++;
    
-    zerocalc(x);
-    signcalc(x);
+    nzcalc(c->x);
 }
 
-static void iny() {
-    y++;
+HANDLER void iny(CPU6502 *c) {
+    c->y++;
    
-    zerocalc(y);
-    signcalc(y);
+    nzcalc(c->y);
 }
 
-static void jmp() {
-    pc = ea;
+HANDLER void jmp(CPU6502 *c) {
+    c->pc = c->ea;
 }
 
-static void jsr() {
-    push16(pc - 1);
-    pc = ea;
+HANDLER void jsr(CPU6502 *c) {
+    push16(c, c->pc - 1);
+    c->pc = c->ea;
 }
 
-static void lda() {
-    penaltyop = 1;
-    value = getvalue();
-    a = (uint8_t)(value & 0x00FF);
+HANDLER void lda(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->a = (uint8_t)(c->value & 0x00FF);
    
-    zerocalc(a);
-    signcalc(a);
+    nzcalc(c->a);
 }
 
-static void ldx() {
-    penaltyop = 1;
-    value = getvalue();
-    x = (uint8_t)(value & 0x00FF);
+HANDLER void ldx(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->x = (uint8_t)(c->value & 0x00FF);
    
-    zerocalc(x);
-    signcalc(x);
+    nzcalc(c->x);
 }
 
-static void ldy() {
-    penaltyop = 1;
-    value = getvalue();
-    y = (uint8_t)(value & 0x00FF);
+HANDLER void ldy(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->y = (uint8_t)(c->value & 0x00FF);
    
-    zerocalc(y);
-    signcalc(y);
+    nzcalc(c->y);
 }
 
-static void lsr() {
-    value = getvalue();
-    result = value >> 1;
+HANDLER void lsr(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = c->value >> 1;
    
-    if (value & 1) setcarry();
+    if (c->value & 1) setcarry();
         else clearcarry();
-    zerocalc(result);
-    signcalc(result);
+    nzcalc(c->result);
    
-    putvalue(result);
+    putvalue(c, c->result);
 }
 
-static void nop() {
-    switch (opcode) {
+HANDLER void lsra(CPU6502 *c) {
+    c->value = (uint16_t)c->a;
+    c->result = c->value >> 1;
+
+    if (c->value & 1) setcarry();
+        else clearcarry();
+    nzcalc(c->result);
+
+    saveaccum(c->result);
+}
+
+HANDLER void nop(CPU6502 *c) {
+    switch (c->opcode) {
         case 0x1C:
         case 0x3C:
         case 0x5C:
         case 0x7C:
         case 0xDC:
         case 0xFC:
-            penaltyop = 1;
+            c->penaltyop = 1;
             break;
     }
 }
 
-static void ora() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (uint16_t)a | value;
+HANDLER void ora(CPU6502 *c) {
+    c->penaltyop = 1;
+    c->value = getvalue(c);
+    c->result = (uint16_t)c->a | c->value;
    
-    zerocalc(result);
-    signcalc(result);
+    nzcalc(c->result);
    
-    saveaccum(result);
+    saveaccum(c->result);
 }
 
-static void pha() {
-    push8(a);
+HANDLER void pha(CPU6502 *c) {
+    push8(c, c->a);
 }
 
-static void php() {
-    push8(status | FLAG_BREAK);
+HANDLER void php(CPU6502 *c) {
+    status6502(c);
+    push8(c, c->status | FLAG_BREAK);
 }
 
-static void pla() {
-    a = pull8();
+HANDLER void pla(CPU6502 *c) {
+    c->a = pull8(c);
    
-    zerocalc(a);
-    signcalc(a);
+    nzcalc(c->a);
 }
 
-static void plp() {
-    status = pull8() | FLAG_CONSTANT;
+HANDLER void plp(CPU6502 *c) {
+    c->status = pull8(c) | FLAG_CONSTANT;
+    c->lazynz = 0;
 }
 
-static void rol() {
-    value = getvalue();
-    result = (value << 1) | (status & FLAG_CARRY);
+HANDLER void rol(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = (c->value << 1) | (c->status & FLAG_CARRY);
    
-    carrycalc(result);
-    zerocalc(result);
-    signcalc(result);
+    carrycalc(c->result);
+    nzcalc(c->result);
    
-    putvalue(result);
+    putvalue(c, c->result);
 }
 
-static void ror() {
-    value = getvalue();
-    result = (value >> 1) | ((status & FLAG_CARRY) << 7);
+HANDLER void rola(CPU6502 *c) {
+    c->value = (uint16_t)c->a;
+    c->result = (c->value << 1) | (c->status & FLAG_CARRY);
+
+    carrycalc(c->result);
+    nzcalc(c->result);
+
+    saveaccum(c->result);
+}
+
+HANDLER void ror(CPU6502 *c) {
+    c->value = getvalue(c);
+    c->result = (c->value >> 1) | ((c->status & FLAG_CARRY) << 7);
    
-    if (value & 1) setcarry();
+    if (c->value & 1) setcarry();
         else clearcarry();
-    zerocalc(result);
-    signcalc(result);
+    nzcalc(c->result);
    
-    putvalue(result);
+    putvalue(c, c->result);
 }
 
-static void rti() {
-    status = pull8();
-    value = pull16();
-    pc = value;
+HANDLER void rora(CPU6502 *c) {
+    c->value = (uint16_t)c->a;
+    c->result = (c->value >> 1) | ((c->status & FLAG_CARRY) << 7);
+
+    if (c->value & 1) setcarry();
+        else clearcarry();
+    nzcalc(c->result);
+
+    saveaccum(c->result);
+}
+
+HANDLER void rti(CPU6502 *c) {
+    c->status = pull8(c);
+    c->lazynz = 0;
+    c->value = pull16(c);
+    c->pc = c->value;
 }
 
-static void rts() {
-    value = pull16();
-    pc = value + 1;
+HANDLER void rts(CPU6502 *c) {
+    c->value = pull16(c);
+    c->pc = c->value + 1;
 }
 
-static void sbc() {
-    penaltyop = 1;
-    value = getvalue() ^ 0x00FF;
-    result = (uint16_t)a + value + (uint16_t)(status & FLAG_CARRY);
+HANDLER void sbc(CPU6502 *c) {
+    uint16_t carry = c->status & FLAG_CARRY;
+
+    c->penaltyop = 1;
+    c->value = getvalue(c) ^ 0x00FF;
+    c->result = (uint16_t)c->a + c->value + carry;
    
-    carrycalc(result);
-    zerocalc(result);
-    overflowcalc(result, a, value);
-    signcalc(result);
+    carrycalc(c->result);
+    nzcalc(c->result);
+    overflowcalc(c->result, c->a, c->value);
 
     #ifndef NES_CPU
-    if (status & FLAG_DECIMAL) {
-        clearcarry();
-        
-        result -= 0x66;
-        if ((result & 0x0F) > 0x09) {
-            result += 0x06;
-        }
-        if ((result & 0xF0) > 0x90) {
-            result += 0x60;
-            setcarry();
-        }
-        
-        clockticks6502++;
+    if (c->status & FLAG_DECIMAL) {
+        uint8_t low = bcdsbc[BCDLOW(c->a, c->value ^ 0xFF, carry)];
+        uint8_t high = bcdsbc[BCDHIGH(c->a, c->value ^ 0xFF, low)];
+
+        c->result = ((high & 0x0F) << 4) | (low & 0x0F);
+        c->clockticks6502++;
     }
     #endif
    
-    saveaccum(result);
+    saveaccum(c->result);
 }
 
-static void sec() {
+HANDLER void sec(CPU6502 *c) {
     setcarry();
 }
 
-static void sed() {
+HANDLER void sed(CPU6502 *c) {
     setdecimal();
 }
 
-static void sei() {
+HANDLER void sei(CPU6502 *c) {
     setinterrupt();
 }
 
-static void sta() {
-    putvalue(a);
+HANDLER void sta(CPU6502 *c) {
+    putvalue(c, c->a);
 }
 
-static void stx() {
-    putvalue(x);
+HANDLER void stx(CPU6502 *c) {
+    putvalue(c, c->x);
 }
 
-static void sty() {
-    putvalue(y);
+HANDLER void sty(CPU6502 *c) {
+    putvalue(c, c->y);
 }
 
-static void tax() {
-    x = a;
+HANDLER void tax(CPU6502 *c) {
+    c->x = c->a;
    
-    zerocalc(x);
-    signcalc(x);
+    nzcalc(c->x);
 }
 
-static void tay() {
-    y = a;
+HANDLER void tay(CPU6502 *c) {
+    c->y = c->a;
    
-    zerocalc(y);
-    signcalc(y);
+    nzcalc(c->y);
 }
 
-static void tsx() {
-    x = sp;
+HANDLER void tsx(CPU6502 *c) {
+    c->x = c->sp;
    
-    zerocalc(x);
-    signcalc(x);
+    nzcalc(c->x);
 }
 
-static void txa() {
-    a = x;
+HANDLER void txa(CPU6502 *c) {
+    c->a = c->x;
    
-    zerocalc(a);
-    signcalc(a);
+    nzcalc(c->a);
 }
 
-static void txs() {
-    sp = x;
+HANDLER void txs(CPU6502 *c) {
+    c->sp = c->x;
 }
 
-static void tya() {
-    a = y;
+HANDLER void tya(CPU6502 *c) {
+    c->a = c->y;
    
-    zerocalc(a);
-    signcalc(a);
+    nzcalc(c->a);
 }
 
 //undocumented instructions
 #ifdef UNDOCUMENTED
-    static void lax() {
-        lda();
-        ldx();
+    HANDLER void lax(CPU6502 *c) {
+        lda(c);
+        ldx(c);
     }
 
-    static void sax() {
-        sta();
-        stx();
-        putvalue(a & x);
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    HANDLER void sax(CPU6502 *c) {
+        sta(c);
+        stx(c);
+        putvalue(c, c->a & c->x);
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502--;
     }
 
-    static void dcp() {
-        dec();
-        cmp();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    HANDLER void dcp(CPU6502 *c) {
+        dec(c);
+        cmp(c);
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502--;
     }
 
-    static void isb() {
-        inc();
-        sbc();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    HANDLER void isb(CPU6502 *c) {
+        inc(c);
+        sbc(c);
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502--;
     }
 
-    static void slo() {
-        asl();
-        ora();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    HANDLER void slo(CPU6502 *c) {
+        asl(c);
+        ora(c);
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502--;
     }
 
-    static void rla() {
-        rol();
-        and();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    HANDLER void rla(CPU6502 *c) {
+        rol(c);
+        and(c);
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502--;
     }
 
-    static void sre() {
-        lsr();
-        eor();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    HANDLER void sre(CPU6502 *c) {
+        lsr(c);
+        eor(c);
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502--;
     }
 
-    static void rra() {
-        ror();
-        adc();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    HANDLER void rra(CPU6502 *c) {
+        ror(c);
+        adc(c);
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502--;
     }
 #else
     #define lax nop
@@ -845,7 +940,8 @@ static void tya() {
 #endif
 
 
-static void (*addrtable[256])() = {
+#ifdef TABLE_CORE
+static void (*addrtable[256])(CPU6502 *) = {
 /*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |     */
 /* 0 */     imp, indx,  imp, indx,   zp,   zp,   zp,   zp,  imp,  imm,  acc,  imm, abso, abso, abso, abso, /* 0 */
 /* 1 */     rel, indy,  imp, indy,  zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absy, absx, absx, absx, absx, /* 1 */
@@ -865,15 +961,15 @@ static void (*addrtable[256])() = {
 /* F */     rel, indy,  imp, indy,  zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absy, absx, absx, absx, absx  /* F */
 };
 
-static void (*optable[256])() = {
+static void (*optable[256])(CPU6502 *) = {
 /*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |      */
-/* 0 */      brk,  ora,  nop,  slo,  nop,  ora,  asl,  slo,  php,  ora,  asl,  nop,  nop,  ora,  asl,  slo, /* 0 */
+/* 0 */      brk,  ora,  nop,  slo,  nop,  ora,  asl,  slo,  php,  ora, asla,  nop,  nop,  ora,  asl,  slo, /* 0 */
 /* 1 */      bpl,  ora,  nop,  slo,  nop,  ora,  asl,  slo,  clc,  ora,  nop,  slo,  nop,  ora,  asl,  slo, /* 1 */
-/* 2 */      jsr,  and,  nop,  rla,  bit,  and,  rol,  rla,  plp,  and,  rol,  nop,  bit,  and,  rol,  rla, /* 2 */
+/* 2 */      jsr,  and,  nop,  rla,  bit,  and,  rol,  rla,  plp,  and, rola,  nop,  bit,  and,  rol,  rla, /* 2 */
 /* 3 */      bmi,  and,  nop,  rla,  nop,  and,  rol,  rla,  sec,  and,  nop,  rla,  nop,  and,  rol,  rla, /* 3 */
-/* 4 */      rti,  eor,  nop,  sre,  nop,  eor,  lsr,  sre,  pha,  eor,  lsr,  nop,  jmp,  eor,  lsr,  sre, /* 4 */
+/* 4 */      rti,  eor,  nop,  sre,  nop,  eor,  lsr,  sre,  pha,  eor, lsra,  nop,  jmp,  eor,  lsr,  sre, /* 4 */
 /* 5 */      bvc,  eor,  nop,  sre,  nop,  eor,  lsr,  sre,  cli,  eor,  nop,  sre,  nop,  eor,  lsr,  sre, /* 5 */
-/* 6 */      rts,  adc,  nop,  rra,  nop,  adc,  ror,  rra,  pla,  adc,  ror,  nop,  jmp,  adc,  ror,  rra, /* 6 */
+/* 6 */      rts,  adc,  nop,  rra,  nop,  adc,  ror,  rra,  pla,  adc, rora,  nop,  jmp,  adc,  ror,  rra, /* 6 */
 /* 7 */      bvs,  adc,  nop,  rra,  nop,  adc,  ror,  rra,  sei,  adc,  nop,  rra,  nop,  adc,  ror,  rra, /* 7 */
 /* 8 */      nop,  sta,  nop,  sax,  sty,  sta,  stx,  sax,  dey,  nop,  txa,  nop,  sty,  sta,  stx,  sax, /* 8 */
 /* 9 */      bcc,  sta,  nop,  nop,  sty,  sta,  stx,  sax,  tya,  sta,  txs,  nop,  nop,  sta,  nop,  nop, /* 9 */
@@ -885,6 +981,283 @@ static void (*optable[256])() = {
 /* F */      beq,  sbc,  nop,  isb,  nop,  sbc,  inc,  isb,  sed,  sbc,  nop,  isb,  nop,  sbc,  inc,  isb  /* F */
 };
 
+const char *core6502 = "table";
+
+HANDLER void dispatch(CPU6502 *c) {
+    (*addrtable[c->opcode])(c);
+    (*optable[c->opcode])(c);
+}
+#else
+//fused core: one switch per opcode with the addressing mode baked into each
+//case. the handlers and dispatch itself are all forced inline, so the switch
+//ends up in the middle of the exec6502 loop and each case is the complete
+//instruction, with a single jump per instruction and no calls. the cases
+//mirror addrtable and optable above, which are still built with TABLE_CORE
+//as the reference core.
+const char *core6502 = "fused";
+
+HANDLER void dispatch(CPU6502 *c) {
+    switch (c->opcode) {
+        case 0x00: imp(c); brk(c); break;
+        case 0x01: indx(c); ora(c); break;
+        case 0x02: imp(c); nop(c); break;
+        case 0x03: indx(c); slo(c); break;
+        case 0x04: zp(c); nop(c); break;
+        case 0x05: zp(c); ora(c); break;
+        case 0x06: zp(c); asl(c); break;
+        case 0x07: zp(c); slo(c); break;
+        case 0x08: imp(c); php(c); break;
+        case 0x09: imm(c); ora(c); break;
+        case 0x0A: acc(c); asla(c); break;
+        case 0x0B: imm(c); nop(c); break;
+        case 0x0C: abso(c); nop(c); break;
+        case 0x0D: abso(c); ora(c); break;
+        case 0x0E: abso(c); asl(c); break;
+        case 0x0F: abso(c); slo(c); break;
+        case 0x10: rel(c); bpl(c); break;
+        case 0x11: indy(c); ora(c); break;
+        case 0x12: imp(c); nop(c); break;
+        case 0x13: indy(c); slo(c); break;
+        case 0x14: zpx(c); nop(c); break;
+        case 0x15: zpx(c); ora(c); break;
+        case 0x16: zpx(c); asl(c); break;
+        case 0x17: zpx(c); slo(c); break;
+        case 0x18: imp(c); clc(c); break;
+        case 0x19: absy(c); ora(c); break;
+        case 0x1A: imp(c); nop(c); break;
+        case 0x1B: absy(c); slo(c); break;
+        case 0x1C: absx(c); nop(c); break;
+        case 0x1D: absx(c); ora(c); break;
+        case 0x1E: absx(c); asl(c); break;
+        case 0x1F: absx(c); slo(c); break;
+        case 0x20: abso(c); jsr(c); break;
+        case 0x21: indx(c); and(c); break;
+        case 0x22: imp(c); nop(c); break;
+        case 0x23: indx(c); rla(c); break;
+        case 0x24: zp(c); bit(c); break;
+        case 0x25: zp(c); and(c); break;
+        case 0x26: zp(c); rol(c); break;
+        case 0x27: zp(c); rla(c); break;
+        case 0x28: imp(c); plp(c); break;
+        case 0x29: imm(c); and(c); break;
+        case 0x2A: acc(c); rola(c); break;
+        case 0x2B: imm(c); nop(c); break;
+        case 0x2C: abso(c); bit(c); break;
+        case 0x2D: abso(c); and(c); break;
+        case 0x2E: abso(c); rol(c); break;
+        case 0x2F: abso(c); rla(c); break;
+        case 0x30: rel(c); bmi(c); break;
+        case 0x31: indy(c); and(c); break;
+        case 0x32: imp(c); nop(c); break;
+        case 0x33: indy(c); rla(c); break;
+        case 0x34: zpx(c); nop(c); break;
+        case 0x35: zpx(c); and(c); break;
+        case 0x36: zpx(c); rol(c); break;
+        case 0x37: zpx(c); rla(c); break;
+        case 0x38: imp(c); sec(c); break;
+        case 0x39: absy(c); and(c); break;
+        case 0x3A: imp(c); nop(c); break;
+        case 0x3B: absy(c); rla(c); break;
+        case 0x3C: absx(c); nop(c); break;
+        case 0x3D: absx(c); and(c); break;
+        case 0x3E: absx(c); rol(c); break;
+        case 0x3F: absx(c); rla(c); break;
+        case 0x40: imp(c); rti(c); break;
+        case 0x41: indx(c); eor(c); break;
+        case 0x42: imp(c); nop(c); break;
+        case 0x43: indx(c); sre(c); break;
+        case 0x44: zp(c); nop(c); break;
+        case 0x45: zp(c); eor(c); break;
+        case 0x46: zp(c); lsr(c); break;
+        case 0x47: zp(c); sre(c); break;
+        case 0x48: imp(c); pha(c); break;
+        case 0x49: imm(c); eor(c); break;
+        case 0x4A: acc(c); lsra(c); break;
+        case 0x4B: imm(c); nop(c); break;
+        case 0x4C: abso(c); jmp(c); break;
+        case 0x4D: abso(c); eor(c); break;
+        case 0x4E: abso(c); lsr(c); break;
+        case 0x4F: abso(c); sre(c); break;
+        case 0x50: rel(c); bvc(c); break;
+        case 0x51: indy(c); eor(c); break;
+        case 0x52: imp(c); nop(c); break;
+        case 0x53: indy(c); sre(c); break;
+        case 0x54: zpx(c); nop(c); break;
+        case 0x55: zpx(c); eor(c); break;
+        case 0x56: zpx(c); lsr(c); break;
+        case 0x57: zpx(c); sre(c); break;
+        case 0x58: imp(c); cli(c); break;
+        case 0x59: absy(c); eor(c); break;
+        case 0x5A: imp(c); nop(c); break;
+        case 0x5B: absy(c); sre(c); break;
+        case 0x5C: absx(c); nop(c); break;
+        case 0x5D: absx(c); eor(c); break;
+        case 0x5E: absx(c); lsr(c); break;
+        case 0x5F: absx(c); sre(c); break;
+        case 0x60: imp(c); rts(c); break;
+        case 0x61: indx(c); adc(c); break;
+        case 0x62: imp(c); nop(c); break;
+        case 0x63: indx(c); rra(c); break;
+        case 0x64: zp(c); nop(c); break;
+        case 0x65: zp(c); adc(c); break;
+        case 0x66: zp(c); ror(c); break;
+        case 0x67: zp(c); rra(c); break;
+        case 0x68: imp(c); pla(c); break;
+        case 0x69: imm(c); adc(c); break;
+        case 0x6A: acc(c); rora(c); break;
+        case 0x6B: imm(c); nop(c); break;
+        case 0x6C: ind(c); jmp(c); break;
+        case 0x6D: abso(c); adc(c); break;
+        case 0x6E: abso(c); ror(c); break;
+        case 0x6F: abso(c); rra(c); break;
+        case 0x70: rel(c); bvs(c); break;
+        case 0x71: indy(c); adc(c); break;
+        case 0x72: imp(c); nop(c); break;
+        case 0x73: indy(c); rra(c); break;
+        case 0x74: zpx(c); nop(c); break;
+        case 0x75: zpx(c); adc(c); break;
+        case 0x76: zpx(c); ror(c); break;
+        case 0x77: zpx(c); rra(c); break;
+        case 0x78: imp(c); sei(c); break;
+        case 0x79: absy(c); adc(c); break;
+        case 0x7A: imp(c); nop(c); break;
+        case 0x7B: absy(c); rra(c); break;
+        case 0x7C: absx(c); nop(c); break;
+        case 0x7D: absx(c); adc(c); break;
+        case 0x7E: absx(c); ror(c); break;
+        case 0x7F: absx(c); rra(c); break;
+        case 0x80: imm(c); nop(c); break;
+        case 0x81: indx(c); sta(c); break;
+        case 0x82: imm(c); nop(c); break;
+        case 0x83: indx(c); sax(c); break;
+        case 0x84: zp(c); sty(c); break;
+        case 0x85: zp(c); sta(c); break;
+        case 0x86: zp(c); stx(c); break;
+        case 0x87: zp(c); sax(c); break;
+        case 0x88: imp(c); dey(c); break;
+        case 0x89: imm(c); nop(c); break;
+        case 0x8A: imp(c); txa(c); break;
+        case 0x8B: imm(c); nop(c); break;
+        case 0x8C: abso(c); sty(c); break;
+        case 0x8D: abso(c); sta(c); break;
+        case 0x8E: abso(c); stx(c); break;
+        case 0x8F: abso(c); sax(c); break;
+        case 0x90: rel(c); bcc(c); break;
+        case 0x91: indy(c); sta(c); break;
+        case 0x92: imp(c); nop(c); break;
+        case 0x93: indy(c); nop(c); break;
+        case 0x94: zpx(c); sty(c); break;
+        case 0x95: zpx(c); sta(c); break;
+        case 0x96: zpy(c); stx(c); break;
+        case 0x97: zpy(c); sax(c); break;
+        case 0x98: imp(c); tya(c); break;
+        case 0x99: absy(c); sta(c); break;
+        case 0x9A: imp(c); txs(c); break;
+        case 0x9B: absy(c); nop(c); break;
+        case 0x9C: absx(c); nop(c); break;
+        case 0x9D: absx(c); sta(c); break;
+        case 0x9E: absy(c); nop(c); break;
+        case 0x9F: absy(c); nop(c); break;
+        case 0xA0: imm(c); ldy(c); break;
+        case 0xA1: indx(c); lda(c); break;
+        case 0xA2: imm(c); ldx(c); break;
+        case 0xA3: indx(c); lax(c); break;
+        case 0xA4: zp(c); ldy(c); break;
+        case 0xA5: zp(c); lda(c); break;
+        case 0xA6: zp(c); ldx(c); break;
+        case 0xA7: zp(c); lax(c); break;
+        case 0xA8: imp(c); tay(c); break;
+        case 0xA9: imm(c); lda(c); break;
+        case 0xAA: imp(c); tax(c); break;
+        case 0xAB: imm(c); nop(c); break;
+        case 0xAC: abso(c); ldy(c); break;
+        case 0xAD: abso(c); lda(c); break;
+        case 0xAE: abso(c); ldx(c); break;
+        case 0xAF: abso(c); lax(c); break;
+        case 0xB0: rel(c); bcs(c); break;
+        case 0xB1: indy(c); lda(c); break;
+        case 0xB2: imp(c); nop(c); break;
+        case 0xB3: indy(c); lax(c); break;
+        case 0xB4: zpx(c); ldy(c); break;
+        case 0xB5: zpx(c); lda(c); break;
+        case 0xB6: zpy(c); ldx(c); break;
+        case 0xB7: zpy(c); lax(c); break;
+        case 0xB8: imp(c); clv(c); break;
+        case 0xB9: absy(c); lda(c); break;
+        case 0xBA: imp(c); tsx(c); break;
+        case 0xBB: absy(c); lax(c); break;
+        case 0xBC: absx(c); ldy(c); break;
+        case 0xBD: absx(c); lda(c); break;
+        case 0xBE: absy(c); ldx(c); break;
+        case 0xBF: absy(c); lax(c); break;
+        case 0xC0: imm(c); cpy(c); break;
+        case 0xC1: indx(c); cmp(c); break;
+        case 0xC2: imm(c); nop(c); break;
+        case 0xC3: indx(c); dcp(c); break;
+        case 0xC4: zp(c); cpy(c); break;
+        case 0xC5: zp(c); cmp(c); break;
+        case 0xC6: zp(c); dec(c); break;
+        case 0xC7: zp(c); dcp(c); break;
+        case 0xC8: imp(c); iny(c); break;
+        case 0xC9: imm(c); cmp(c); break;
+        case 0xCA: imp(c); dex(c); break;
+        case 0xCB: imm(c); nop(c); break;
+        case 0xCC: abso(c); cpy(c); break;
+        case 0xCD: abso(c); cmp(c); break;
+        case 0xCE: abso(c); dec(c); break;
+        case 0xCF: abso(c); dcp(c); break;
+        case 0xD0: rel(c); bne(c); break;
+        case 0xD1: indy(c); cmp(c); break;
+        case 0xD2: imp(c); nop(c); break;
+        case 0xD3: indy(c); dcp(c); break;
+        case 0xD4: zpx(c); nop(c); break;
+        case 0xD5: zpx(c); cmp(c); break;
+        case 0xD6: zpx(c); dec(c); break;
+        case 0xD7: zpx(c); dcp(c); break;
+        case 0xD8: imp(c); cld(c); break;
+        case 0xD9: absy(c); cmp(c); break;
+        case 0xDA: imp(c); nop(c); break;
+        case 0xDB: absy(c); dcp(c); break;
+        case 0xDC: absx(c); nop(c); break;
+        case 0xDD: absx(c); cmp(c); break;
+        case 0xDE: absx(c); dec(c); break;
+        case 0xDF: absx(c); dcp(c); break;
+        case 0xE0: imm(c); cpx(c); break;
+        case 0xE1: indx(c); sbc(c); break;
+        case 0xE2: imm(c); nop(c); break;
+        case 0xE3: indx(c); isb(c); break;
+        case 0xE4: zp(c); cpx(c); break;
+        case 0xE5: zp(c); sbc(c); break;
+        case 0xE6: zp(c); inc(c); break;
+        case 0xE7: zp(c); isb(c); break;
+        case 0xE8: imp(c); inx(c); break;
+        case 0xE9: imm(c); sbc(c); break;
+        case 0xEA: imp(c); nop(c); break;
+        case 0xEB: imm(c); sbc(c); break;
+        case 0xEC: abso(c); cpx(c); break;
+        case 0xED: abso(c); sbc(c); break;
+        case 0xEE: abso(c); inc(c); break;
+        case 0xEF: abso(c); isb(c); break;
+        case 0xF0: rel(c); beq(c); break;
+        case 0xF1: indy(c); sbc(c); break;
+        case 0xF2: imp(c); nop(c); break;
+        case 0xF3: indy(c); isb(c); break;
+        case 0xF4: zpx(c); nop(c); break;
+        case 0xF5: zpx(c); sbc(c); break;
+        case 0xF6: zpx(c); inc(c); break;
+        case 0xF7: zpx(c); isb(c); break;
+        case 0xF8: imp(c); sed(c); break;
+        case 0xF9: absy(c); sbc(c); break;
+        case 0xFA: imp(c); nop(c); break;
+        case 0xFB: absy(c); isb(c); break;
+        case 0xFC: absx(c); nop(c); break;
+        case 0xFD: absx(c); sbc(c); break;
+        case 0xFE: absx(c); inc(c); break;
+        case 0xFF: absx(c); isb(c); break;
+    }
+}
+#endif
+
 static const uint32_t ticktable[256] = {
 /*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |     */
 /* 0 */      7,    6,    2,    8,    3,    3,    5,    5,    3,    2,    2,    2,    4,    4,    6,    6,  /* 0 */
@@ -906,66 +1279,57 @@ static const uint32_t ticktable[256] = {
 };
 
 
-void nmi6502() {
-    push16(pc);
-    push8(status);
-    status |= FLAG_INTERRUPT;
-    pc = (uint16_t)read6502(0xFFFA) | ((uint16_t)read6502(0xFFFB) << 8);
+void nmi6502(CPU6502 *c) {
+    status6502(c);
+    push16(c, c->pc);
+    push8(c, c->status);
+    c->status |= FLAG_INTERRUPT;
+    c->pc = (uint16_t)memread(c, 0xFFFA) | ((uint16_t)memread(c, 0xFFFB) << 8);
 }
 
-void irq6502() {
-    push16(pc);
-    push8(status);
-    status |= FLAG_INTERRUPT;
-    pc = (uint16_t)read6502(0xFFFE) | ((uint16_t)read6502(0xFFFF) << 8);
+void irq6502(CPU6502 *c) {
+    status6502(c);
+    push16(c, c->pc);
+    push8(c, c->status);
+    c->status |= FLAG_INTERRUPT;
+    c->pc = (uint16_t)memread(c, 0xFFFE) | ((uint16_t)memread(c, 0xFFFF) << 8);
 }
 
-uint8_t callexternal = 0;
-void (*loopexternal)();
-
-void exec6502(uint32_t tickcount) {
-    clockgoal6502 += tickcount;
+void exec6502(CPU6502 *c, uint32_t tickcount) {
+    c->clockgoal6502 += tickcount;
    
-    while (clockticks6502 < clockgoal6502) {
-        opcode = read6502(pc++);
-        status |= FLAG_CONSTANT;
+    //compare through a signed difference so the loop still works when
+    //the 32-bit tick counters wrap around
+    while ((int32_t)(c->clockticks6502 - c->clockgoal6502) < 0) {
+        c->opcode = memread(c, c->pc++);
+        c->status |= FLAG_CONSTANT;
 
-        penaltyop = 0;
-        penaltyaddr = 0;
+        c->penaltyop = 0;
+        c->penaltyaddr = 0;
 
-        (*addrtable[opcode])();
-        (*optable[opcode])();
-        clockticks6502 += ticktable[opcode];
-        if (penaltyop && penaltyaddr) clockticks6502++;
+        dispatch(c);
+        c->clockticks6502 += ticktable[c->opcode];
+        if (c->penaltyop && c->penaltyaddr) c->clockticks6502++;
 
-        instructions++;
+        c->instructions++;
 
-        if (callexternal) (*loopexternal)();
+        if (c->callexternal) (*c->loopexternal)(c);
     }
 
+    status6502(c);
 }
 
-void step6502() {
-    opcode = read6502(pc++);
-    status |= FLAG_CONSTANT;
-
-    penaltyop = 0;
-    penaltyaddr = 0;
-
-    (*addrtable[opcode])();
-    (*optable[opcode])();
-    clockticks6502 += ticktable[opcode];
-    if (penaltyop && penaltyaddr) clockticks6502++;
-    clockgoal6502 = clockticks6502;
-
-    instructions++;
-
-    if (callexternal) (*loopexternal)();
+//one instruction, through the same loop as exec6502 so there is only the
+//one copy of the inlined core
+void step6502(CPU6502 *c) {
+    c->clockgoal6502 = c->clockticks6502;
+    exec6502(c, 1);
+    c->clockgoal6502 = c->clockticks6502;
 }
 
-void hookexternal(void *funcptr) {
+void hookexternal(CPU6502 *c, void *funcptr) {
     if (funcptr != (void *)NULL) {
-        loopexternal = funcptr;
-        callexternal = 1;
-    } else callexternal = 0;
+        c->loopexternal = funcptr;
+        c->callexternal = 1;
+    } else c->callexternal = 0;
 }
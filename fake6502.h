@@ -0,0 +1,69 @@
+/* Fake6502 CPU emulator core - public interface
+ *
+ * All of the CPU state lives in a CPU6502 struct, so any number of CPUs
+ * can run in one process. Every entry point takes a pointer to the CPU it
+ * operates on, and the same pointer is handed back to read6502() and
+ * write6502(). A host that needs more context than the CPU itself should
+ * make the CPU6502 the first member of its own struct and cast the
+ * pointer back in its callbacks.
+ *
+ * Pages of plain RAM or ROM can be mapped into readmap/writemap so the core
+ * accesses them without calling back into the host at all. */
+#ifndef FAKE6502_H
+#define FAKE6502_H
+
+#include <stdint.h>
+
+//status register bits
+#define FLAG_CARRY     0x01
+#define FLAG_ZERO      0x02
+#define FLAG_INTERRUPT 0x04
+#define FLAG_DECIMAL   0x08
+#define FLAG_BREAK     0x10
+#define FLAG_CONSTANT  0x20
+#define FLAG_OVERFLOW  0x40
+#define FLAG_SIGN      0x80
+
+typedef struct CPU6502 {
+    //6502 CPU registers
+    uint16_t pc;
+    uint8_t sp, a, x, y, status;
+
+    //helper variables
+    uint32_t instructions; //keep track of total instructions executed
+    uint32_t clockticks6502, clockgoal6502;
+    uint16_t oldpc, ea, reladdr, value, result;
+    uint8_t opcode, oldstatus;
+
+    //while the core runs, N and Z may only be in nzresult (N is its top
+    //bit, Z is set if it is 0), when lazynz is set. status6502() puts
+    //them back into status.
+    uint8_t nzresult, lazynz;
+    uint8_t penaltyop, penaltyaddr;
+
+    uint8_t callexternal;
+    void (*loopexternal)(struct CPU6502 *);
+
+    //memory map, one entry per 256-byte page. a non-NULL entry points at
+    //plain memory the core reads or writes directly, a NULL entry sends the
+    //access to read6502/write6502
+    uint8_t *readmap[256];
+    uint8_t *writemap[256];
+} CPU6502;
+
+void reset6502(CPU6502 *c);
+void exec6502(CPU6502 *c, uint32_t tickcount);
+void step6502(CPU6502 *c);
+void irq6502(CPU6502 *c);
+void nmi6502(CPU6502 *c);
+void status6502(CPU6502 *c);
+void hookexternal(CPU6502 *c, void *funcptr);
+
+//name of the dispatch core this build uses ("fused" or "table")
+extern const char *core6502;
+
+//externally supplied functions
+extern uint8_t read6502(CPU6502 *c, uint16_t address);
+extern void write6502(CPU6502 *c, uint16_t address, uint8_t value);
+
+#endif
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "headless.h"
+
+// The 6530-002's IRQ vector, where BRK lands
+#define IRQ_ENTRY 0x1c1f
+
+// Cycles to run between serial input top-ups
+#define HEADLESS_SLICE 10000
+
+void headless_stop(KIM1Machine *m, char *reason) {
+    HEADLESS *h = (HEADLESS *) m->user;
+
+    if (h->reason == NULL) {
+        h->reason = reason;
+    }
+    kim1_stop(m);
+}
+
+/* BRK and IRQ both land here, a BRK is told apart by the break flag it
+ * pushed. The machine is backed up to the BRK itself so the result shows
+ * where it was hit. */
+void brk_trap(KIM1Machine *m) {
+    uint8_t status = m->ram[0x100 + (uint8_t) (m->cpu.sp + 1)];
+    uint16_t pc;
+
+    if (!(status & FLAG_BREAK)) {
+        return;
+    }
+    pc = m->ram[0x100 + (uint8_t) (m->cpu.sp + 2)] | (m->ram[0x100 + (uint8_t) (m->cpu.sp + 3)] << 8);
+    m->cpu.status = status & ~FLAG_BREAK;
+    m->cpu.sp += 3;
+    m->cpu.pc = pc - 2;
+    headless_stop(m, "brk");
+}
+
+void stop_pc_trap(KIM1Machine *m) {
+    headless_stop(m, "pc");
+}
+
+void budget_event(KIM1Machine *m) {
+    headless_stop(m, "cycles");
+}
+
+void input_event(KIM1Machine *m) {
+    HEADLESS *h = (HEADLESS *) m->user;
+
+    while ((h->script_pos < h->script_len) && !serial_in_queue_full(m)) {
+        serial_in_queue_put(m, h->script[h->script_pos++]);
+    }
+    if (h->script_pos < h->script_len) {
+        kim1_schedule(m, kim1_cycles(m) + HEADLESS_SLICE, input_event);
+    }
+}
+
+void serial_out_headless(KIM1Machine *m, uint8_t b) {
+    HEADLESS *h = (HEADLESS *) m->user;
+    int len;
+
+    // Drop the NULs the ROM echoes while it polls an idle serial line
+    if (b == 0) {
+        return;
+    }
+    serial_out_stdout(m, b);
+
+    if (h->stop_output) {
+        len = strlen(h->stop_output);
+        if (h->window_len == len) {
+            memmove(h->window, h->window + 1, len - 1);
+            h->window_len--;
+        }
+        h->window[h->window_len++] = b;
+        if ((h->window_len == len) && !memcmp(h->window, h->stop_output, len)) {
+            headless_stop(m, "output");
+        }
+    }
+}
+
+/* Run the machine until one of the stop conditions is met, print the
+ * result and return the exit status. */
+int headless_run(KIM1Machine *m, HEADLESS *h) {
+    FILE *in;
+    uint64_t start;
+    uint64_t instructions = 0;
+    uint64_t left;
+    uint32_t last_instructions, slice;
+    int status = HEADLESS_STOPPED;
+
+    m->user = h;
+    m->serial_out = serial_out_headless;
+    m->auto_tape = 0;
+    m->kim1_serial_mode = 1;
+
+    if (h->input) {
+        if ((in = fopen(h->input, "rb")) == NULL) {
+            perror(h->input);
+            return HEADLESS_ERROR;
+        }
+        fseek(in, 0, SEEK_END);
+        h->script_len = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        h->script = malloc(h->script_len > 0 ? h->script_len : 1);
+        h->script_len = fread(h->script, 1, h->script_len, in);
+        fclose(in);
+        input_event(m);
+    }
+    if (h->stop_output && h->stop_output[0]) {
+        h->window = malloc(strlen(h->stop_output));
+    } else {
+        h->stop_output = NULL;
+    }
+    if (h->stop_brk) {
+        kim1_add_trap(m, IRQ_ENTRY, brk_trap);
+    }
+    if (h->stop_pc_set) {
+        kim1_add_trap(m, h->stop_pc, stop_pc_trap);
+    }
+
+    start = kim1_cycles(m);
+    if (h->max_cycles) {
+        kim1_schedule(m, start + h->max_cycles, budget_event);
+    }
+
+    last_instructions = m->cpu.instructions;
+    while (h->reason == NULL) {
+        slice = HEADLESS_SLICE;
+        if (h->max_instructions) {
+            // No instruction is shorter than 2 cycles, so a run of twice
+            // the instructions left can't overshoot the budget
+            left = h->max_instructions - instructions;
+            if (left == 0) {
+                h->reason = "instructions";
+                break;
+            }
+            if (left < slice / 2) {
+                slice = 2 * left;
+            }
+        }
+        kim1_run(m, slice);
+        instructions += (uint32_t) (m->cpu.instructions - last_instructions);
+        last_instructions = m->cpu.instructions;
+    }
+    m->stopped = 0;
+
+    if (!strcmp(h->reason, "cycles") || !strcmp(h->reason, "instructions")) {
+        status = HEADLESS_BUDGET;
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "stop=%s pc=%04x a=%02x x=%02x y=%02x sp=%02x status=%02x cycles=%llu instructions=%llu ram=%016llx\n",
+            h->reason, m->cpu.pc, m->cpu.a, m->cpu.x, m->cpu.y, m->cpu.sp, m->cpu.status,
+            (unsigned long long) (kim1_cycles(m) - start), (unsigned long long) instructions,
+            (unsigned long long) kim1_ram_hash(m));
+
+    free(h->script);
+    free(h->window);
+    return status;
+}
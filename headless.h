@@ -0,0 +1,38 @@
+/* Headless runs for scripts and CI. The terminal is left alone, the
+ * machine runs as fast as it can and stops on BRK, on reaching an address,
+ * when its serial output contains a string or when a cycle or instruction
+ * budget runs out. The result is written to stderr as one line of
+ * name=value pairs. */
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdint.h>
+#include "kim1machine.h"
+
+// Exit statuses from headless_run
+#define HEADLESS_STOPPED 0      // a stop condition was met
+#define HEADLESS_ERROR 1
+#define HEADLESS_BUDGET 2       // the cycle or instruction budget ran out
+
+typedef struct HEADLESS {
+    // Options, set by the caller
+    char *input;                // file fed to the serial port, or NULL
+    int stop_brk;
+    int stop_pc_set;
+    uint16_t stop_pc;
+    char *stop_output;          // stop once the serial output contains this
+    uint64_t max_cycles;        // 0 means no limit
+    uint64_t max_instructions;  // 0 means no limit
+
+    // Run state
+    char *reason;
+    uint8_t *script;
+    long script_len;
+    long script_pos;
+    char *window;               // the last strlen(stop_output) characters out
+    int window_len;
+} HEADLESS;
+
+int headless_run(KIM1Machine *m, HEADLESS *h);
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include "input.h"
+
+INPUT_RING input_ring;
+
+// Signalled after each read, for an idle emulator blocked in
+// input_wait_until
+pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t input_arrived;
+
+// How long input_wait sleeps between looks at an empty ring
+#define INPUT_WAIT_NANOS 1000000L
+
+/* The producer side. When the ring is full the thread waits for the
+ * emulator to catch up rather than dropping input, so pasted or piped
+ * text is never lost. */
+void *input_thread(void *arg) {
+    uint8_t buf[256];
+    struct timespec wait = { 0, INPUT_WAIT_NANOS };
+    uint32_t head;
+    int n;
+
+    while ((n = read(0, buf, sizeof(buf))) > 0) {
+        for (int i=0; i < n; i++) {
+            head = atomic_load_explicit(&input_ring.head, memory_order_relaxed);
+            while (head - atomic_load_explicit(&input_ring.tail, memory_order_acquire) == INPUT_RING_SIZE) {
+                nanosleep(&wait, NULL);
+            }
+            input_ring.buf[head & (INPUT_RING_SIZE-1)] = buf[i];
+            atomic_store_explicit(&input_ring.head, head + 1, memory_order_release);
+        }
+        pthread_mutex_lock(&input_lock);
+        pthread_cond_signal(&input_arrived);
+        pthread_mutex_unlock(&input_lock);
+    }
+    atomic_store_explicit(&input_ring.eof, 1, memory_order_release);
+    pthread_mutex_lock(&input_lock);
+    pthread_cond_signal(&input_arrived);
+    pthread_mutex_unlock(&input_lock);
+    return NULL;
+}
+
+void input_start() {
+    pthread_t thread;
+    pthread_condattr_t attr;
+
+    // The timeouts are on the same clock as the pacer's deadlines
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&input_arrived, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&thread, NULL, input_thread, NULL) != 0) {
+        perror("pthread_create");
+        return;
+    }
+    pthread_detach(thread);
+}
+
+/* Returns the number of bytes waiting in the ring */
+int input_ready() {
+    return atomic_load_explicit(&input_ring.head, memory_order_acquire) -
+        atomic_load_explicit(&input_ring.tail, memory_order_relaxed);
+}
+
+/* Returns the next byte, or -1 if there is none waiting */
+int input_get() {
+    uint32_t tail = atomic_load_explicit(&input_ring.tail, memory_order_relaxed);
+    uint8_t b;
+
+    if (atomic_load_explicit(&input_ring.head, memory_order_acquire) == tail) {
+        return -1;
+    }
+    b = input_ring.buf[tail & (INPUT_RING_SIZE-1)];
+    atomic_store_explicit(&input_ring.tail, tail + 1, memory_order_release);
+    return b;
+}
+
+/* Waits for the next byte, for prompts that need an answer before the
+ * emulator carries on. Returns -1 once stdin is closed. */
+int input_wait() {
+    struct timespec wait = { 0, INPUT_WAIT_NANOS };
+    int b;
+
+    while ((b = input_get()) < 0) {
+        if (atomic_load_explicit(&input_ring.eof, memory_order_acquire) && !input_ready()) {
+            return -1;
+        }
+        nanosleep(&wait, NULL);
+    }
+    return b;
+}
+
+/* Blocks until a byte is waiting or the CLOCK_MONOTONIC time until has
+ * passed, whichever comes first. Once stdin is closed nothing more can
+ * arrive, so it just sleeps until then. Returns the number of bytes
+ * waiting. */
+int input_wait_until(struct timespec *until) {
+    pthread_mutex_lock(&input_lock);
+    while (!input_ready() && !atomic_load_explicit(&input_ring.eof, memory_order_acquire)) {
+        if (pthread_cond_timedwait(&input_arrived, &input_lock, until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&input_lock);
+    if (!input_ready() && atomic_load_explicit(&input_ring.eof, memory_order_acquire)) {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, until, NULL) == EINTR);
+    }
+    return input_ready();
+}
+
+/* Reads a line, without the line ending, like fgets. Returns the length,
+ * or -1 if stdin closed before anything was read. */
+int input_read_line(char *line, int size) {
+    int len = 0, b;
+
+    while ((b = input_wait()) >= 0) {
+        if ((b == '\n') || (b == '\r')) {
+            break;
+        }
+        if (len < size-1) {
+            line[len++] = b;
+        }
+    }
+    line[len] = 0;
+    return ((b < 0) && (len == 0)) ? -1 : len;
+}
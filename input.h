@@ -0,0 +1,29 @@
+/* Keyboard input for the terminal front end. A background thread blocks
+ * reading stdin and drops each byte into a lock-free single-producer,
+ * single-consumer ring, so the emulator thread only ever checks two
+ * indexes and never makes a system call unless input is waiting. */
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Must be a power of 2
+#define INPUT_RING_SIZE 4096
+
+typedef struct INPUT_RING {
+    uint8_t buf[INPUT_RING_SIZE];
+    _Atomic uint32_t head;      // written only by the input thread
+    _Atomic uint32_t tail;      // written only by the emulator thread
+    _Atomic int eof;
+} INPUT_RING;
+
+void input_start();
+int input_ready();
+int input_get();
+int input_wait();
+int input_wait_until(struct timespec *until);
+int input_read_line(char *line, int size);
+
+#endif
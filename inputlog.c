@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "inputlog.h"
+
+FILE *inputlog_file;
+int inputlog_mode;              // 0 off, 1 recording, 2 replaying
+
+// The next entry to be replayed
+int pending_valid;
+uint64_t pending_cycle;
+char pending_line[INPUTLOG_LINE_SIZE];
+
+int inputlog_record(char *filename) {
+    if ((inputlog_file = fopen(filename, "w")) == NULL) {
+        return -1;
+    }
+    // One write per input, so a crashed session's log is complete
+    setvbuf(inputlog_file, NULL, _IOLBF, 0);
+    inputlog_mode = 1;
+    return 0;
+}
+
+int inputlog_replay(char *filename) {
+    if ((inputlog_file = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    inputlog_mode = 2;
+    inputlog_next();
+    return 0;
+}
+
+int inputlog_recording() {
+    return inputlog_mode == 1;
+}
+
+int inputlog_replaying() {
+    return inputlog_mode == 2;
+}
+
+void inputlog_write(uint64_t cycle, char *line) {
+    fprintf(inputlog_file, "%llu %s\n", (unsigned long long) cycle, line);
+}
+
+/* Look at the next entry to replay. Returns 0 if there is one. */
+int inputlog_peek(uint64_t *cycle, char **line) {
+    if (!pending_valid) {
+        return -1;
+    }
+    *cycle = pending_cycle;
+    *line = pending_line;
+    return 0;
+}
+
+/* Move on to the next entry in the log */
+void inputlog_next() {
+    char buf[INPUTLOG_LINE_SIZE + 32];
+    unsigned long long cycle;
+    int n, len;
+
+    pending_valid = 0;
+    while (fgets(buf, sizeof(buf), inputlog_file) != NULL) {
+        len = strlen(buf);
+        while ((len > 0) && ((buf[len-1] == '\n') || (buf[len-1] == '\r'))) {
+            buf[--len] = 0;
+        }
+        if (sscanf(buf, "%llu %n", &cycle, &n) != 1) {
+            continue;
+        }
+        pending_cycle = cycle;
+        strncpy(pending_line, buf + n, sizeof(pending_line) - 1);
+        pending_line[sizeof(pending_line) - 1] = 0;
+        pending_valid = 1;
+        return;
+    }
+}
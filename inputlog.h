@@ -0,0 +1,21 @@
+/* Record and replay of everything the outside world does to the machine.
+ * Each input is logged as a line of text, "cycle action arguments", with
+ * the emulated cycle it was delivered on. Replaying delivers the same
+ * inputs on the same cycles, so a session runs exactly as it was recorded,
+ * as fast as the host can go. */
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <stdint.h>
+
+#define INPUTLOG_LINE_SIZE 512
+
+int inputlog_record(char *filename);
+int inputlog_replay(char *filename);
+int inputlog_recording();
+int inputlog_replaying();
+void inputlog_write(uint64_t cycle, char *line);
+int inputlog_peek(uint64_t *cycle, char **line);
+void inputlog_next();
+
+#endif
@@ -1,103 +1,91 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <sys/ioctl.h> // For FIONREAD
 #include <termios.h>
 #include <stdbool.h>
 #include <time.h>
 #include <memory.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <stdarg.h>
+#include "kim1machine.h"
+#include "pacer.h"
+#include "input.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "inputlog.h"
+#include "headless.h"
+#include "profile.h"
+#include "trace.h"
+#include "metrics.h"
+#include "debugger.h"
+#include "accel.h"
 
-uint8_t ram[65536];
-
-typedef struct TIMER {
-    uint16_t timer_mult;
-    uint16_t tick_accum;
-    uint8_t start_value;
-    uint8_t timer_count;
-    uint8_t timeout;
-#ifdef REAL_TIMER
-    uint64_t starttime;
-#endif
-} TIMER;
-
-typedef struct RIOT {
-    uint8_t rom[1024];
-    uint8_t ram[64];
-    uint8_t padd, sad;
-    uint8_t pbdd, sbd;
-    TIMER timer;
-} RIOT;
-
-RIOT riot003;
-RIOT riot002;
-
-extern void reset6502();
-extern void exec6502(uint32_t);
-extern void step6502();
-extern void nmi6502();
-extern volatile uint16_t pc;
-extern volatile uint8_t a, x, y, status;
-extern volatile uint32_t clockticks6502;
-
-void load_roms();
-int kbhit(bool);
 int reset_term();
-long current_time_millis();
-void do_step();
-void check_pc();
-void handle_kb();
-void show_display();
-uint8_t riot003read(uint16_t);
-uint8_t riot002read(uint16_t);
-void riot003write(uint16_t, uint8_t);
-void riot002write(uint16_t, uint8_t);
-void update_timer(TIMER *, uint32_t);
-void reset_timer(TIMER *, int, uint8_t);
+void set_raw();
+void handle_kb(KIM1Machine *);
+void show_display(KIM1Machine *);
+void tape_prompt(KIM1Machine *, int);
 void read_string(char *, int);
-
-uint8_t read6502(uint16_t);
-void write6502(uint16_t, uint8_t);
-
-uint8_t display[6];
-uint8_t display_changed;
-long display_changed_time;
-
-uint8_t char_pending;
-
-uint8_t single_step;
-
-struct timespec last_tick_time;
+void poll_event(KIM1Machine *);
+void replay_event(KIM1Machine *);
+void end_replay(KIM1Machine *);
+void deliver(KIM1Machine *, char *, ...);
+void apply_input(KIM1Machine *, char *);
+void write_profile();
+void finish_trace();
 
 char input_line[512];
 
-uint8_t sending_serial;
-uint8_t serial_out_count;
-uint8_t serial_out_byte;
-uint8_t serial_out_bit_ready;
+// Where the snapshot hotkey saves to, if given on the command line
+char *snapshot_file = NULL;
 
-uint8_t serial_in_byte;
-uint8_t kim1_serial_mode;
+// Where the profile report goes on exit, if profiling
+char *profile_file = NULL;
 
-#define SERIAL_IN_QUEUE_SIZE 1024
-uint8_t serial_in_queue[SERIAL_IN_QUEUE_SIZE];
-int serial_in_queue_start = 0;
-int serial_in_queue_end = 0;
+// Metrics reporting, if turned on
+char *metrics_target = NULL;
+METRICS metrics;
 
-int max_ram = 1024;
+// Where the trace goes, and how many instructions to keep if it is only
+// written out on request
+char *trace_file = NULL;
+int trace_last = 0;
 
-char paper_tape_filename[1024];
-FILE *paper_tape_file = NULL;
-int auto_tape = 1;
-int reading_paper_tape = 0;
-int writing_paper_tape = 0;
+// How often, in emulated cycles, the keyboard and display are polled
+#define POLL_CYCLES 10000
+
+KIM1Machine kim1;
 
-uint8_t trace;
 int main(int argc, char *argv[]) {
-    uint32_t curr_ticks;
-    struct timespec tv, nsleep;
-    uint8_t enable_SST_NMI;
+    KIM1Machine *m = &kim1;
+    int max_ram = 1024;
+    int auto_tape = 1;
+    uint32_t speed = 1;
+    char *tape = NULL;
+    char *snapshot_load_file = NULL;
+    int rewind_seconds = 60;
+    int fast_tty = 1;
+    int idle_detect = 1;
+    int fast_timers = 0;
+    uint32_t accel = 0;
+    int flush_policy = FLUSH_FRAME;
+    char *record_file = NULL;
+    char *replay_file = NULL;
+    char *load_file = NULL;
+    uint16_t load_addr = 0;
+    int start_set = 0;
+    uint16_t start_addr = 0;
+    int headless = 0;
+    int flush_set = 0;
+    HEADLESS h;
+    int status;
+    FILE *tape_file;
+    PACER pacer;
+    uint32_t run;
+    struct timespec until;
+
+    memset(&h, 0, sizeof(h));
 
     for (int i=1; i < argc; i++) {
         if (!strcmp(argv[i], "-ram") || !strcmp(argv[i], "--ram")) {
@@ -118,7 +106,7 @@ int main(int argc, char *argv[]) {
             i++;
         } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-help") ||
             !strcmp(argv[i], "--h") || !strcmp(argv[i], "--help")) {
-            printf("Usage:  kim1 [-ram size] [-autotape y/n]\n  where size = 1k, 2k, 3k, 4k, or 5k\n");
+            printf("Usage:  kim1 [-ram size] [-autotape y/n] [-speed s] [-tape file]\n            [-tty fast/exact] [-flush line/frame/exit] [-idle y/n]\n            [-fast-timers] [-accel list]\n            [-snapshot-load file] [-snapshot-save file] [-rewind seconds]\n            [-record file] [-replay file]\n            [-load file addr] [-start addr] [-headless] [-input file]\n            [-stop-brk] [-stop-pc addr] [-stop-output string]\n            [-max-cycles n] [-max-instructions n] [-profile file]\n            [-trace file] [-trace-last n] [-metrics file|unix:path]\n  where size = 1k, 2k, 3k, 4k, or 5k\n");
             printf("\nThe ram size currently specifies the amount of memory available below\n");
             printf("the ROM. The ROM starts at 17E7, which is just below 6K, so for now\n");
             printf("it is limited to 5k, leaving about 1000 bytes unavailable.\n");
@@ -126,6 +114,44 @@ int main(int argc, char *argv[]) {
             printf("filename when you load or save a paper tape. For the save, do the\n");
             printf("normal routine of putting the length at 17F7-F8, and jumping to the\n");
             printf("start address, it will prompt for a save filename when you hit Q.\n");
+            printf("The speed option runs the emulator at 1x (the default), 10x or any\n");
+            printf("other multiple of the KIM-1's 1 MHz clock up to 100000x, or as fast as it\n");
+            printf("can with max.\n");
+            printf("The tape option loads a KIM-1 format paper tape into memory at startup.\n");
+            printf("With tty fast (the default), characters the KIM-1 prints on the serial\n");
+            printf("port are passed straight to the terminal, exact sends them bit by bit\n");
+            printf("at the KIM-1's own speed. Serial output is flushed at the end of each\n");
+            printf("line, on each poll of the keyboard (frame, the default) or only on exit.\n");
+            printf("With idle on (the default), the emulator sleeps while the ROM waits for a\n");
+            printf("key or serial character instead of running its wait loop.\n");
+            printf("The fast-timers option skips straight through loops that only poll\n");
+            printf("a RIOT timer, to the pass that sees it change, with exact cycle counts.\n");
+            printf("The accel option runs some ROM routines natively, charging the cycles\n");
+            printf("the ROM would take: a comma separated list of prtbyt, pack, chk, ak,\n");
+            printf("getkey and scand, or all.\n");
+            printf("Shift-S saves a snapshot of the whole machine to the snapshot-save file\n");
+            printf("(or prompts for one), and snapshot-load starts from a saved snapshot.\n");
+            printf("Shift-R rewinds the machine by a number of seconds, up to the last 60\n");
+            printf("seconds or however many the rewind option gives (0 turns it off).\n");
+            printf("The record option logs every key, serial character and file load with\n");
+            printf("the cycle it happened on, and replay plays a log back at full speed with\n");
+            printf("the same options, ending up in exactly the same state.\n");
+            printf("The load option puts a binary file into RAM and start sets the pc.\n");
+            printf("Headless runs without the terminal, as fast as it can, with the input\n");
+            printf("file fed to the serial port, until a BRK, reaching the stop-pc address,\n");
+            printf("serial output containing the stop-output string, or the cycle or\n");
+            printf("instruction budget running out. The result goes to stderr and the exit\n");
+            printf("status is 0 for a stop condition and 2 for the budget.\n");
+            printf("The profile option counts the instructions and cycles run at each\n");
+            printf("address and writes a disassembled report of the hot spots on exit.\n");
+            printf("The trace option writes every instruction to a binary trace file, read\n");
+            printf("it with kim1-tracedump. With trace-last only the last n instructions are\n");
+            printf("kept, and written when a headless run fails or shift-T is pressed.\n");
+            printf("The metrics option writes a line of JSON every second with the\n");
+            printf("effective clock rate, pacing lag, host CPU, syscall, display, serial\n");
+            printf("and trap rates, to a file or to a Unix datagram socket.\n");
+            printf("Shift-D opens the debugger console, where breakpoints and watchpoints\n");
+            printf("can be set and memory and registers examined. Type h there for help.\n");
             exit(0);
         } else if (!strcmp(argv[i], "-autotape")) {
             if (i >= argc-1) {
@@ -140,110 +166,447 @@ int main(int argc, char *argv[]) {
                 printf("Must specify y or n for autotape\n");
                 exit(1);
             }
+        } else if (!strcmp(argv[i], "-tape")) {
+            if (i >= argc-1) {
+                printf("Must specify a paper tape file\n");
+                exit(1);
+            }
+            tape = argv[++i];
+        } else if (!strcmp(argv[i], "-snapshot-save") || !strcmp(argv[i], "-snapshot-load")) {
+            if (i >= argc-1) {
+                printf("Must specify a snapshot file\n");
+                exit(1);
+            }
+            if (!strcmp(argv[i], "-snapshot-save")) {
+                snapshot_file = argv[++i];
+            } else {
+                snapshot_load_file = argv[++i];
+            }
+        } else if (!strcmp(argv[i], "-record") || !strcmp(argv[i], "-replay")) {
+            if (i >= argc-1) {
+                printf("Must specify an input log file\n");
+                exit(1);
+            }
+            if (!strcmp(argv[i], "-record")) {
+                record_file = argv[++i];
+            } else {
+                replay_file = argv[++i];
+            }
+        } else if (!strcmp(argv[i], "-load")) {
+            if ((i >= argc-2) || !isxdigit(argv[i+2][0])) {
+                printf("Must specify a file and a hex load address\n");
+                exit(1);
+            }
+            load_file = argv[++i];
+            load_addr = strtoul(argv[++i], NULL, 16);
+        } else if (!strcmp(argv[i], "-start") || !strcmp(argv[i], "-stop-pc")) {
+            if ((i >= argc-1) || !isxdigit(argv[i+1][0])) {
+                printf("Must specify a hex address for %s\n", argv[i]);
+                exit(1);
+            }
+            if (!strcmp(argv[i], "-start")) {
+                start_set = 1;
+                start_addr = strtoul(argv[++i], NULL, 16);
+            } else {
+                h.stop_pc_set = 1;
+                h.stop_pc = strtoul(argv[++i], NULL, 16);
+            }
+        } else if (!strcmp(argv[i], "-max-cycles") || !strcmp(argv[i], "-max-instructions")) {
+            if ((i >= argc-1) || !isdigit(argv[i+1][0])) {
+                printf("Must specify a number for %s\n", argv[i]);
+                exit(1);
+            }
+            if (!strcmp(argv[i], "-max-cycles")) {
+                h.max_cycles = strtoull(argv[++i], NULL, 10);
+            } else {
+                h.max_instructions = strtoull(argv[++i], NULL, 10);
+            }
+        } else if (!strcmp(argv[i], "-input") || !strcmp(argv[i], "-stop-output")) {
+            if (i >= argc-1) {
+                printf("Must specify a value for %s\n", argv[i]);
+                exit(1);
+            }
+            if (!strcmp(argv[i], "-input")) {
+                h.input = argv[++i];
+            } else {
+                h.stop_output = argv[++i];
+            }
+        } else if (!strcmp(argv[i], "-profile")) {
+            if (i >= argc-1) {
+                printf("Must specify a file for the profile report\n");
+                exit(1);
+            }
+            profile_file = argv[++i];
+        } else if (!strcmp(argv[i], "-trace")) {
+            if (i >= argc-1) {
+                printf("Must specify a trace file\n");
+                exit(1);
+            }
+            trace_file = argv[++i];
+        } else if (!strcmp(argv[i], "-metrics")) {
+            if (i >= argc-1) {
+                printf("Must specify a metrics file or unix:path\n");
+                exit(1);
+            }
+            metrics_target = argv[++i];
+        } else if (!strcmp(argv[i], "-trace-last")) {
+            if ((i >= argc-1) || !isdigit(argv[i+1][0])) {
+                printf("Must specify the number of instructions to keep\n");
+                exit(1);
+            }
+            trace_last = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-stop-brk")) {
+            h.stop_brk = 1;
+        } else if (!strcmp(argv[i], "-headless")) {
+            headless = 1;
+        } else if (!strcmp(argv[i], "-fast-timers")) {
+            fast_timers = 1;
+        } else if (!strcmp(argv[i], "-accel")) {
+            if ((i >= argc-1) || (accel_parse(argv[i+1], &accel) < 0)) {
+                printf("Must specify accel as a list of prtbyt, pack, chk, ak, getkey, scand, or all\n");
+                exit(1);
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-rewind")) {
+            if ((i >= argc-1) || !isdigit(argv[i+1][0])) {
+                printf("Must specify the number of seconds to keep for rewind\n");
+                exit(1);
+            }
+            rewind_seconds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-tty")) {
+            if ((i < argc-1) && !strcmp(argv[i+1], "fast")) {
+                fast_tty = 1;
+            } else if ((i < argc-1) && !strcmp(argv[i+1], "exact")) {
+                fast_tty = 0;
+            } else {
+                printf("Must specify fast or exact for tty\n");
+                exit(1);
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-idle")) {
+            if ((i < argc-1) && ((argv[i+1][0] == 'y') || (argv[i+1][0] == 'Y'))) {
+                idle_detect = 1;
+            } else if ((i < argc-1) && ((argv[i+1][0] == 'n') || (argv[i+1][0] == 'N'))) {
+                idle_detect = 0;
+            } else {
+                printf("Must specify y or n for idle\n");
+                exit(1);
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-flush")) {
+            if ((i < argc-1) && !strcmp(argv[i+1], "line")) {
+                flush_policy = FLUSH_LINE;
+            } else if ((i < argc-1) && !strcmp(argv[i+1], "frame")) {
+                flush_policy = FLUSH_FRAME;
+            } else if ((i < argc-1) && !strcmp(argv[i+1], "exit")) {
+                flush_policy = FLUSH_EXIT;
+            } else {
+                printf("Must specify line, frame or exit for flush\n");
+                exit(1);
+            }
+            flush_set = 1;
+            i++;
+        } else if (!strcmp(argv[i], "-speed")) {
+            if ((i >= argc-1) || (parse_speed(argv[i+1], &speed) < 0)) {
+                printf("Must specify speed as 1x, 10x (any multiple up to 100000x) or max\n");
+                exit(1);
+            }
+            i++;
         }
     }
-    // Initialize the RIOT chips
-    memset(&riot002, 0, sizeof(RIOT));
-    memset(&riot003, 0, sizeof(RIOT));
+    // Load the 2 ROM files
+    load_roms();
 
-    // No character pending
-    char_pending = 0x15;
+    // Initialize the RIOT chips, set the ROM vectors and reset the CPU
+    kim1_init(m);
+    kim1_set_ram(m, max_ram);
+    m->auto_tape = auto_tape;
+    m->tape_prompt = tape_prompt;
+    m->fast_tty = fast_tty;
+    m->fast_timers = fast_timers;
+    m->flush_policy = flush_policy;
+    setvbuf(stdout, NULL, _IOFBF, 65536);
+
+    if (snapshot_load_file && (snapshot_load(m, snapshot_load_file) < 0)) {
+        printf("Unable to load snapshot %s\n", snapshot_load_file);
+        exit(1);
+    }
 
-    sending_serial = 0;
-    kim1_serial_mode = 0;
+    if (tape) {
+        if ((tape_file = fopen(tape, "r")) == NULL) {
+            perror(tape);
+            exit(1);
+        }
+        if (kim1_load_tape(m, tape_file) != TAPE_OK) {
+            printf("Unable to load paper tape %s\n", tape);
+            exit(1);
+        }
+        fclose(tape_file);
+    }
 
-    // Load the 2 ROM files
-    load_roms();
+    if (load_file) {
+        if (load_addr >= m->max_ram) {
+            printf("Load address is not in RAM\n");
+            exit(1);
+        }
+        if ((tape_file = fopen(load_file, "rb")) == NULL) {
+            perror(load_file);
+            exit(1);
+        }
+        kim1_load_binary(m, tape_file, load_addr);
+        fclose(tape_file);
+    }
+    if (start_set) {
+        m->cpu.pc = start_addr;
+    }
+    kim1_set_accel(m, accel);
 
-    // Set the vectors that the KIM-1 ROM uses
-    write6502(0x17fa, 0);
-    write6502(0x17fb, 0x1c);
-    write6502(0x17fe, 0);
-    write6502(0x17ff, 0x1c);
+    if (profile_file) {
+        profile_start(m);
+        atexit(write_profile);
+    }
+    if (trace_last > 0) {
+        if (trace_file == NULL) {
+            printf("Must give a trace file for trace-last\n");
+            exit(1);
+        }
+        trace_start_ring(m, trace_last);
+    } else if (trace_file) {
+        if (trace_start_file(m, trace_file) < 0) {
+            perror(trace_file);
+            exit(1);
+        }
+        atexit(finish_trace);
+    }
 
-    // Turn single step off
-    single_step = 0;
+    if (headless) {
+        // Output only needs to come out at the end unless asked otherwise
+        if (!flush_set) {
+            m->flush_policy = FLUSH_EXIT;
+        }
+        status = headless_run(m, &h);
+        if ((status != HEADLESS_STOPPED) && m->trace && !m->trace->file) {
+            trace_dump(m, trace_file);
+        }
+        exit(status);
+    }
 
-    // Reset the CPU
-    reset6502();
+    if (record_file && (inputlog_record(record_file) < 0)) {
+        perror(record_file);
+        exit(1);
+    }
+    if (replay_file) {
+        if (inputlog_replay(replay_file) < 0) {
+            perror(replay_file);
+            exit(1);
+        }
+        // Nothing to wait for, the inputs all come from the log
+        speed = 0;
+    }
+    // Only the interactive front end has a person watching for these, on
+    // stdout they would end up mixed in with the serial output
+    m->report_stray_writes = 1;
 
-    clock_gettime(CLOCK_REALTIME, &last_tick_time);
+    // Headless runs keep to the ROM's own wait loops, so their cycle and
+    // instruction counts don't depend on it
+    m->idle_detect = idle_detect;
 
-    trace = 0;
+    // Put the terminal in raw mode and start reading keys in the background
+    set_raw();
+    input_start();
 
-    for (;;) {
+    pacer_start(&pacer, speed);
 
+    if (metrics_target && (metrics_open(&metrics, metrics_target, m, &pacer) < 0)) {
+        perror(metrics_target);
+        exit(1);
+    }
 
-        if (trace) {
-            printf("pc=%04x  status=%02x  a=%02x  x=%02x  y=%02x   sbd=%02x\n", pc, status, a, x, y, riot002.sbd);
+    if (rewind_seconds > 0) {
+        rewind_start(m, rewind_seconds);
+    }
+
+    // Keyboard and display are polled from an event on the machine's
+    // schedule, so the CPU runs undisturbed between polls
+    kim1_schedule(m, POLL_CYCLES, poll_event);
+    if (replay_file) {
+        replay_event(m);
+    }
+
+    run = pacer.slice;
+    for (;;) {
+        kim1_run(m, run);
+        run = pacer.slice;
+
+        // A breakpoint, watchpoint or the debugger key stopped the machine
+        if (m->stopped) {
+            m->stopped = 0;
+            reset_term();
+            debugger_console(m);
+            set_raw();
         }
 
-        // Try to simulate a 1MHz clock speed
-        clock_gettime(CLOCK_REALTIME, &tv);
-        if (tv.tv_sec == last_tick_time.tv_sec) {
-            if (tv.tv_nsec - last_tick_time.tv_nsec < 1000) {
-                nsleep.tv_sec = 0;
-                nsleep.tv_nsec = tv.tv_nsec - last_tick_time.tv_nsec;
-                nanosleep(&nsleep, NULL);
+        if (m->idle_trap && !inputlog_replaying()) {
+            // The ROM is waiting for input that hasn't come. Sleep until it
+            // does or the next event is due, then catch the machine up
+            // with the time that went by, and pick up the input right away.
+            pacer_idle_deadline(&pacer, kim1_next_event(m) - kim1_cycles(m), &until);
+            input_wait_until(&until);
+            run = pacer_idle_end(&pacer);
+            if (input_ready()) {
+                kim1_schedule(m, kim1_cycles(m) + run, poll_event);
             }
+        } else {
+            // Sleep off whatever is left of the slice
+            pacer_wait(&pacer);
         }
 
-        // This seems like a hack but it's basically how the hardware does it
-        enable_SST_NMI = single_step && (pc < 0x1c00);
+        if (metrics_target) {
+            metrics_update(&metrics, m, &pacer);
+        }
+    }
+}
 
-        do_step();
+/* Runs every POLL_CYCLES emulated cycles to pick up keystrokes and refresh
+ * the display. */
+void poll_event(KIM1Machine *m) {
+    // If the display has changed, update it, but no faster than every 100ms
+    // since we don't need to see the result of every keystroke
+    if (m->display_changed && !m->kim1_serial_mode) {
+        if (current_time_millis() - m->display_changed_time > 100) {
+            show_display(m);
+            fflush(stdout);
+            m->display_changed = 0;
+            metrics.display_refreshes++;
+        }
+    }
 
-        if (single_step && enable_SST_NMI) {
-            nmi6502();
+    // Process a key if one has been hit. In serial mode, pass along as
+    // much as the serial queue can take so pasted text keeps up. While
+    // replaying, the keyboard is ignored.
+    if (!inputlog_replaying() && input_ready()) {
+        handle_kb(m);
+        while (m->kim1_serial_mode && input_ready() && !serial_in_queue_full(m)) {
+            handle_kb(m);
         }
+    }
 
-        // Check where the CPU is
-        check_pc();
+    if (m->flush_policy != FLUSH_EXIT) {
+        fflush(stdout);
+    }
 
-        // If the display has changed, update it, but no faster than every 100ms
-        // since we don't need to see the result of every keystroke
-        if (display_changed && !kim1_serial_mode) {
-            if (current_time_millis() - display_changed_time > 100) {
-                show_display();
-                fflush(stdout);
-                display_changed = 0;
-            }
+    kim1_schedule(m, kim1_cycles(m) + POLL_CYCLES, poll_event);
+}
+
+/* Apply every logged input that is due by now, then wait for the next one.
+ * The replay ends with the log. */
+void replay_event(KIM1Machine *m) {
+    uint64_t cycle;
+    char *line;
+
+    while (inputlog_peek(&cycle, &line) == 0) {
+        if (cycle > kim1_cycles(m)) {
+            kim1_schedule(m, cycle, replay_event);
+            return;
         }
-        
-        // If a key has been hit, process it
-        if (kbhit(false)) {
-            handle_kb();
+        // A tape answer that tape_prompt didn't ask for has nothing to apply
+        if (strncmp(line, "tape", 4)) {
+            apply_input(m, line);
         }
+        inputlog_next();
     }
+    end_replay(m);
 }
 
-int serial_in_queue_ready() {
-    return serial_in_queue_start != serial_in_queue_end;
+/* A replay runs far too fast for the display to be refreshed along the
+ * way, so show where it ended up. */
+void end_replay(KIM1Machine *m) {
+    if (!m->kim1_serial_mode) {
+        show_display(m);
+    }
+    printf("Replay finished at cycle %llu\n", (unsigned long long) kim1_cycles(m));
+    fflush(stdout);
+    reset_term();
+    exit(0);
 }
 
-void serial_in_queue_put(uint8_t b) {
-    serial_in_queue[serial_in_queue_end] = b;
-    serial_in_queue_end = (serial_in_queue_end + 1) % SERIAL_IN_QUEUE_SIZE;
+/* Everything the host does to the machine goes through here as a line of
+ * text, so it can be recorded and played back. */
+void deliver(KIM1Machine *m, char *fmt, ...) {
+    char line[INPUTLOG_LINE_SIZE];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (inputlog_recording()) {
+        inputlog_write(kim1_cycles(m), line);
+    }
+    apply_input(m, line);
 }
 
-uint8_t serial_in_queue_get() {
-    uint8_t b;
-    if (serial_in_queue_start == serial_in_queue_end) return 0;
-    b = serial_in_queue[serial_in_queue_start];
-    serial_in_queue_start = (serial_in_queue_start + 1) % SERIAL_IN_QUEUE_SIZE;
-    return b;
+void apply_input(KIM1Machine *m, char *line) {
+    char action[32];
+    unsigned int v;
+    int n;
+
+    if (sscanf(line, "%31s %n", action, &n) != 1) {
+        return;
+    }
+    line += n;
+    if (!strcmp(action, "key")) {
+        sscanf(line, "%x", &v);
+        m->char_pending = v;
+    } else if (!strcmp(action, "serial")) {
+        sscanf(line, "%x", &v);
+        serial_in_queue_put(m, v);
+    } else if (!strcmp(action, "serialmode")) {
+        m->kim1_serial_mode = atoi(line);
+        m->display_changed = !m->kim1_serial_mode;
+    } else if (!strcmp(action, "reset")) {
+        reset6502(&m->cpu);
+    } else if (!strcmp(action, "nmi")) {
+        nmi6502(&m->cpu);
+    } else if (!strcmp(action, "step")) {
+        kim1_set_single_step(m, atoi(line));
+    } else if (!strcmp(action, "poke")) {
+        // poke addr followed by the bytes, all in hex
+        if (sscanf(line, "%x %n", &v, &n) != 1) {
+            return;
+        }
+        line += n;
+        for (uint16_t addr = v; (addr < m->max_ram) && isxdigit(line[0]) && isxdigit(line[1]); addr++) {
+            sscanf(line, "%2x", &v);
+            kim1_poke(m, addr, v);
+            line += 2;
+        }
+    } else if (!strcmp(action, "rewind")) {
+        if (m->rewind) {
+            printf("Rewound %.1f seconds\n", rewind_back(m, atof(line)));
+        }
+    } else if (!strcmp(action, "exit")) {
+        if (inputlog_replaying()) {
+            end_replay(m);
+        }
+        fflush(stdout);
+        reset_term();
+        exit(0);
+    }
 }
 
-void do_step() {
-    // Reset the CPU tick count so we can get the number of ticks
-    // this instruction took
-    clockticks6502 = 0;
-    step6502();
-    clock_gettime(CLOCK_REALTIME, &last_tick_time);
+void write_profile() {
+    FILE *out;
+
+    if ((out = fopen(profile_file, "w")) == NULL) {
+        perror(profile_file);
+        return;
+    }
+    profile_report(&kim1, out);
+    fclose(out);
+}
 
-    // Update the 6530 timers
-    update_timer(&riot002.timer, clockticks6502);
-    update_timer(&riot003.timer, clockticks6502);
+void finish_trace() {
+    trace_stop(&kim1);
 }
 
 void set_raw() {
@@ -259,22 +622,6 @@ void set_raw() {
     setbuf(stdin, NULL);
 }
 
-int kbhit(bool init) {
-    static bool initflag = false;
-    static const int STDIN = 0;
-
-    // If raw mode hasn't been turned on yet, turn it on
-    if (init || !initflag) {
-        set_raw();
-        initflag = true;
-    }
-
-    // Return the number of bytes available to read
-    int nbbytes;
-    ioctl(STDIN, FIONREAD, &nbbytes);  // 0 is STDIN
-    return nbbytes;
-}
-
 int reset_term() {
     static const int STDIN = 0;
 
@@ -288,297 +635,269 @@ int reset_term() {
     setbuf(stdin, NULL);
 }
 
-long current_time_millis() {
-    struct timespec tv;
-    clock_gettime(CLOCK_REALTIME, &tv);
-    return tv.tv_sec * 1000 + tv.tv_nsec / 1000000;
-}
-
-uint64_t current_time_nanos() {
-    struct timespec tv;
-    uint64_t ct;
-    clock_gettime(CLOCK_REALTIME, &tv);
-    return tv.tv_sec * 1000000000 + tv.tv_nsec;
-}
-
-void load_roms() {
-    FILE *in;
-
-    if ((in = fopen("6530-002.bin", "rb")) == NULL) {
-        fprintf(stderr, "Can't open 6530-002.bin\n");
-        exit(1);
-    }
-    fread(riot002.rom, 1, sizeof(riot002.rom), in);
-    fclose(in);
+/* Prompt for the paper tape file when the ROM starts a load (writing=0)
+ * or a save (writing=1). An empty answer returns to the monitor and a
+ * "-" lets the tape go through the serial port as typed or pasted text. */
+void tape_prompt(KIM1Machine *m, int writing) {
+    int n;
+    uint64_t cycle;
+    char *line;
+    char log_line[sizeof("tape ") + sizeof(m->paper_tape_filename)];
 
-    if ((in = fopen("6530-003.bin", "rb")) == NULL) {
-        fprintf(stderr, "Can't open 6530-002.bin\n");
-        exit(1);
-    }
-    fread(riot003.rom, 1, sizeof(riot003.rom), in);
-    fclose(in);
-
-}
-
-/* check_pc is a hack to make the simulator a little smoother.
- * It traps the call to display digits, but only late into the
- * processing so programs like Wumpus that display non-standard
- * values can still work. */
-void check_pc() {
-    int digit, n, tap_ch;
-    char ch;
-    char *filename;
-    if (pc == 0x1f56) {
-        digit = 9 - (x >> 1);
-        if (display[digit] != a) {
-            if (!display_changed) {
-                display_changed_time = current_time_millis();
-            }
-            display_changed = 1;
-            display[digit] = a;
-        }
-        pc = 0x1f5e;
-    } else if ((pc == 0x1f79) || (pc == 0x1f90)) {
- // If we get to the place where a character has been read,
- // clear out the pending keyboard character.
-        char_pending = 0x15;
-    } else if (pc == 0x1e5a) {
-        if (serial_in_queue_ready()) {
-            pc = 0x1e85;
-            a = serial_in_queue_get();
-            y = 0xff;
-        } else if (reading_paper_tape) {
-            if ((tap_ch = fgetc(paper_tape_file)) != EOF) {
-                pc = 0x1e85;
-                a = (uint8_t) tap_ch;
-                y = 0xff;
-            } else {
-                fclose(paper_tape_file);
-                reading_paper_tape = 0;
-                printf("Tape loaded.\n");
-            }
-        }
-    } else if (pc == 0x1e04) {
-        if (!auto_tape) {
-            return;
-        }
-        reset_term();
-        for (;;) {
-            printf("Read from file: ");
-            fflush(stdout);
-            n = read(0, paper_tape_filename, sizeof(paper_tape_filename)-1);
-            while ((n > 0) && ((paper_tape_filename[n-1] == 10) || (paper_tape_filename[n-1] == 13))) {
-                paper_tape_filename[--n] = 0;
-            }
-            if (n <= 0) {
-                pc = 0x1c6a;
-                break;
-            }
-            paper_tape_filename[n] = 0;
-            if (!strcmp(paper_tape_filename, "-")) {
-                break;
+    reset_term();
+    for (;;) {
+        printf(writing ? "Write to file: " : "Read from file: ");
+        fflush(stdout);
+        if (inputlog_replaying()) {
+            // The answer comes from the log. A log that has no answer
+            // here ends the tape as if the user had given up.
+            n = -1;
+            if ((inputlog_peek(&cycle, &line) == 0) && !strncmp(line, "tape", 4)) {
+                line += line[4] ? 5 : 4;
+                strncpy(m->paper_tape_filename, line, sizeof(m->paper_tape_filename) - 1);
+                m->paper_tape_filename[sizeof(m->paper_tape_filename) - 1] = 0;
+                n = strlen(m->paper_tape_filename);
+                printf("%s\n", m->paper_tape_filename);
+                inputlog_next();
+                if (inputlog_peek(&cycle, &line) == 0) {
+                    kim1_schedule(m, cycle, replay_event);
+                }
             }
-            if (strlen(paper_tape_filename) > 0) {
-                paper_tape_file = fopen(paper_tape_filename, "r");
-                if (paper_tape_file == NULL) {
-                    perror("fopen");
-                    fflush(stderr);
+        } else {
+            n = input_read_line(m->paper_tape_filename, sizeof(m->paper_tape_filename));
+            if (inputlog_recording()) {
+                // A replay reads back at most INPUTLOG_LINE_SIZE - 1
+                // characters of the line, so a longer name can't be logged
+                if ((n > 0) && (strlen("tape ") + n >= INPUTLOG_LINE_SIZE)) {
+                    printf("The file name is too long to record, use a shorter one\n");
                     continue;
                 }
-                reading_paper_tape = 1;
+                snprintf(log_line, sizeof(log_line), "tape %s", n > 0 ? m->paper_tape_filename : "");
+                inputlog_write(kim1_cycles(m), log_line);
             }
+        }
+        if (n <= 0) {
+            m->cpu.pc = 0x1c6a;
             break;
         }
-        set_raw();
-    } else if (pc == 0x1e01) {
-        reset_term();
-        for (;;) {
-            printf("Write to file: ");
-            fflush(stdout);
-            n = read(0, paper_tape_filename, sizeof(paper_tape_filename)-1);
-            while ((n > 0) && ((paper_tape_filename[n-1] == 10) || (paper_tape_filename[n-1] == 13))) {
-                paper_tape_filename[--n] = 0;
-            }
-            if (n <= 0) {
-                pc = 0x1c6a;
-                break;
-            }
-            paper_tape_filename[n] = 0;
-            if (!strcmp(paper_tape_filename, "-")) break;
-            if (strlen(paper_tape_filename) > 0) {
-                paper_tape_file = fopen(paper_tape_filename, "w");
-                if (paper_tape_file == NULL) {
-                    perror("fopen");
-                    fflush(stderr);
-                    continue;
-                }
-                writing_paper_tape = 1;
-            }
+        if (!strcmp(m->paper_tape_filename, "-")) {
             break;
         }
-        set_raw();
-    } else if (pc == 0x1d77) {
-        if (writing_paper_tape) {
-            printf("Tape saved.\n");
-            fclose(paper_tape_file);
-            writing_paper_tape = 0;
+        if (strlen(m->paper_tape_filename) > 0) {
+            m->paper_tape_file = fopen(m->paper_tape_filename, writing ? "w" : "r");
+            if (m->paper_tape_file == NULL) {
+                perror("fopen");
+                fflush(stderr);
+                continue;
+            }
+            if (writing) {
+                m->writing_paper_tape = 1;
+            } else {
+                m->reading_paper_tape = 1;
+            }
         }
+        break;
     }
+    set_raw();
 }
 
 /* Handle local keyboard interaction. Keys are converted to the keycodes
  * that the KIM-1 ROM expects. They keys are made to match the ones for
  * the KIM-UNO simulator, plus 'l' to load a binary filename. */
-void handle_kb() {
-    char ch;
-    int len;
+void handle_kb(KIM1Machine *m) {
+    int ch;
+    int len, n, i;
     uint16_t addr, save_len;
     FILE *loadfile;
+    uint8_t buf[128];
+    char hex[2 * sizeof(buf) + 1], *p;
 
-    ch = getchar();
+    ch = input_get();
 
-    if (kim1_serial_mode) {
+    if (m->kim1_serial_mode) {
         if (ch == 9) {
-            kim1_serial_mode = 0;
             printf("Exiting KIM-1 Serial Mode\n");
-            display_changed = 1;
+            deliver(m, "serialmode 0");
         } else if (ch == 8) {
-            serial_in_queue_put(0x7f);
+            deliver(m, "serial 7f");
         } else {
-            serial_in_queue_put(ch);
+            deliver(m, "serial %02x", ch);
         }
         return;
     }
 
     if ((ch >= '0') && (ch <= '9')) {
-        char_pending = ch - '0';
+        deliver(m, "key %02x", ch - '0');
     } else if ((ch >= 'a') && (ch <= 'f')) {
-        char_pending = 10 + ch - 'a';
+        deliver(m, "key %02x", 10 + ch - 'a');
     } else if (ch == 1) {           // Ctrl-A
         printf("Address Mode\n");
-        char_pending = 0x10;
+        deliver(m, "key 10");
     } else if (ch == 4) {           // Ctrl-D
         printf("Data Mode\n");
-        char_pending = 0x11;
+        deliver(m, "key 11");
     } else if (ch == 16) {          // Ctrl-P
         printf("PC\n");
-        display_changed=1;
-        char_pending = 0x14;
+        m->display_changed=1;
+        deliver(m, "key 14");
     } else if (ch == '+') {
-        char_pending = 0x12;
+        deliver(m, "key 12");
     } else if (ch == 7) {           // Ctrl-G
         printf("GO\n");
-        char_pending = 0x13;
+        deliver(m, "key 13");
     } else if (ch == 18) {          // Ctrl-R
         printf("RESET\n");
-        reset6502();
+        deliver(m, "reset");
     } else if (ch == 20) {          // Ctrl-T
-        nmi6502();
+        deliver(m, "nmi");
     } else if (ch == 0x1b) {        // Ctrl-[
         printf("Single step OFF\n");
-        single_step = 0;
+        deliver(m, "step 0");
     } else if (ch == 0x1d) {        // Ctrl-]
         printf("Single step ON\n");
-        single_step = 1;
+        deliver(m, "step 1");
     } else if (ch == 'l') {
         reset_term();
         printf("Enter filename: ");
-        fgets(input_line, sizeof(input_line)-1, stdin);
-        len = strlen(input_line);
-        if ((len > 0) && (input_line[len-1] == '\n')) {
-            input_line[len-1] = 0;
-        }
+        input_read_line(input_line, sizeof(input_line));
         printf("Enter load address: ");
         addr = 0;
         for (;;) {
-            ch = getchar();
+            ch = input_wait();
             if ((ch >= '0') && (ch <= '9')) {
                 addr = ((addr << 4) | (ch - '0')) & 0xffff;
             } else if ((ch >= 'a') && (ch <= 'f')) {
                 addr = ((addr << 4) | (ch - 'a' + 10)) & 0xffff;
             } else if ((ch >= 'A') && (ch <= 'F')) {
                 addr = ((addr << 4) | (ch - 'A' + 10)) & 0xffff;
-            } else if ((ch == '\n') || (ch == '\r')) {
+            } else if ((ch == '\n') || (ch == '\r') || (ch < 0)) {
                 break;
             }
         }
-        if (addr >= max_ram) {
+        if (addr >= m->max_ram) {
             printf("Load address is not in RAM");
             fflush(stdout);
-            kbhit(true);
+            set_raw();
             return;
         }
         if ((loadfile = fopen(input_line, "rb")) == NULL) {
             printf("Unable to open file %s\n", input_line);
-            kbhit(true);
+            set_raw();
             return;
         }
-        len = fread(&ram[addr], 1, max_ram-addr, loadfile);
+        // The file goes into RAM as pokes so a replay doesn't need it
+        len = 0;
+        while ((addr + len < m->max_ram) && ((n = fread(buf, 1, sizeof(buf), loadfile)) > 0)) {
+            for (p = hex, i = 0; i < n; i++, p += 2) {
+                sprintf(p, "%02x", buf[i]);
+            }
+            deliver(m, "poke %04x %s", addr + len, hex);
+            len += n;
+        }
         fclose(loadfile);
+        if (len > m->max_ram - addr) {
+            len = m->max_ram - addr;
+        }
         printf("%04x (%d) bytes loaded from %s at %04x\n", len, len, input_line, addr);
         fflush(stdout);
-        kbhit(true);
-        reset6502();
+        set_raw();
+        deliver(m, "reset");
         return;
     } else if (ch == 's') {
         reset_term();
         printf("Enter filename to save to: ");
-        fgets(input_line, sizeof(input_line)-1, stdin);
-        len = strlen(input_line);
-        if ((len > 0) && (input_line[len-1] == '\n')) {
-            input_line[len-1] = 0;
-        }
+        input_read_line(input_line, sizeof(input_line));
         printf("Enter starting address: ");
         addr = 0;
         for (;;) {
-            ch = getchar();
+            ch = input_wait();
             if ((ch >= '0') && (ch <= '9')) {
                 addr = ((addr << 4) | (ch - '0')) & 0xffff;
             } else if ((ch >= 'a') && (ch <= 'f')) {
                 addr = ((addr << 4) | (ch - 'a' + 10)) & 0xffff;
             } else if ((ch >= 'A') && (ch <= 'F')) {
                 addr = ((addr << 4) | (ch - 'A' + 10)) & 0xffff;
-            } else if ((ch == '\n') || (ch == '\r')) {
+            } else if ((ch == '\n') || (ch == '\r') || (ch < 0)) {
                 break;
             }
         }
         printf("Enter # bytes to save in hex: ");
         save_len = 0;
         for (;;) {
-            ch = getchar();
+            ch = input_wait();
             if ((ch >= '0') && (ch <= '9')) {
                 save_len = ((save_len << 4) | (ch - '0')) & 0xffff;
             } else if ((ch >= 'a') && (ch <= 'f')) {
                 save_len = ((save_len << 4) | (ch - 'a' + 10)) & 0xffff;
             } else if ((ch >= 'A') && (ch <= 'F')) {
                 save_len = ((save_len << 4) | (ch - 'A' + 10)) & 0xffff;
-            } else if ((ch == '\n') || (ch == '\r')) {
+            } else if ((ch == '\n') || (ch == '\r') || (ch < 0)) {
                 break;
             }
         }
         if ((loadfile = fopen(input_line, "wb")) == NULL) {
             printf("Unable to open file %s\n", input_line);
             fflush(stdout);
-            kbhit(true);
+            set_raw();
             return;
         }
-        if (addr + save_len > max_ram) {
-            printf("Can't save past top of RAM, saving up to %04x\n", max_ram);
+        if (addr + save_len > m->max_ram) {
+            printf("Can't save past top of RAM, saving up to %04x\n", m->max_ram);
             fflush(stdout);
-            save_len = max_ram - addr;
+            save_len = m->max_ram - addr;
         }
-        len = fwrite(&ram[addr], 1, save_len, loadfile);
+        len = fwrite(&m->ram[addr], 1, save_len, loadfile);
         fclose(loadfile);
         printf("%04x (%d) bytes saved to %s\n", len, len, input_line);
         fflush(stdout);
-        kbhit(true);
+        set_raw();
+        return;
+    } else if (ch == 'R') {
+        if (m->rewind == NULL) {
+            printf("Rewind is turned off\n");
+            return;
+        }
+        reset_term();
+        printf("Rewind how many seconds: ");
+        fflush(stdout);
+        input_read_line(input_line, sizeof(input_line));
+        set_raw();
+        deliver(m, "rewind %g", atof(input_line));
+        return;
+    } else if (ch == 'D') {
+        kim1_stop(m);
+    } else if (ch == 'T') {
+        if ((m->trace == NULL) || m->trace->file) {
+            printf("Use -trace-last to keep a trace to write out\n");
+        } else if (trace_dump(m, trace_file) < 0) {
+            printf("Unable to write trace to %s\n", trace_file);
+        } else {
+            printf("Trace written to %s\n", trace_file);
+        }
+        fflush(stdout);
+        return;
+    } else if (ch == 'S') {
+        if (snapshot_file) {
+            strcpy(input_line, snapshot_file);
+        } else {
+            reset_term();
+            printf("Enter snapshot filename: ");
+            fflush(stdout);
+            input_read_line(input_line, sizeof(input_line));
+            set_raw();
+        }
+        if (snapshot_save(m, input_line) < 0) {
+            printf("Unable to save snapshot to %s\n", input_line);
+        } else {
+            printf("Snapshot saved to %s\n", input_line);
+        }
+        fflush(stdout);
         return;
     } else if (ch == 9) {
-        kim1_serial_mode = 1;
         printf("Entering KIM-1 Serial Mode\n");
+        deliver(m, "serialmode 1");
     } else if (ch == 'x') {
-        reset_term();
-        exit(0);
+        deliver(m, "exit");
     } else {
         if (ch >= 0x20) {
             printf("Unknown char %c\n", ch);
@@ -612,299 +931,13 @@ char get_display_char(uint8_t dc) {
     return ch;
 }
 
-void show_display() {
+void show_display(KIM1Machine *m) {
     printf("%c%c%c%c %c%c\n",
-            get_display_char(display[5]),
-            get_display_char(display[4]),
-            get_display_char(display[3]),
-            get_display_char(display[2]),
-            get_display_char(display[1]),
-            get_display_char(display[0]));
-}
-
-/* Callback from the fake6502 library, handle reads from RAM or the RIOT chips */
-uint8_t read6502(uint16_t address) {
-    if ((address >= 0x1c00) && (address < 0x2000)) {
-        return riot002.rom[address-0x1c00];
-    } else if ((address >= 0x1800) && (address < 0x1c00)) {
-        return riot003.rom[address-0x1800];
-    } else if ((address >= 0x9c00) && (address < 0xa000)) {
-        return riot002.ram[address - 0x9c00];
-    } else if (address >= 0xff00) {
-        return riot002.rom[address - 0xfc00];
-    } else if ((address >= 0x1780) && (address < 0x17c0)) {
-        return riot003.ram[address - 0x1780];
-    } else if ((address >= 0x17c0) && (address < 0x1800)) {
-        return riot002.ram[address - 0x17c0];
-    } else if ((address >= 0x1700) && (address < 0x1740)) {
-        return riot003read(address);
-    } else if ((address >= 0x1740) && (address < 0x1780)) {
-        return riot002read(address);
-    } else if (address < max_ram) {
-        return ram[address];
-    } else {
-        return 0;
-    }
-}
-
-/* Callback from the fake6502 library, handle writes to RAM or the RIOT chips */
-void write6502(uint16_t address, uint8_t value) {
-    if ((address >= 0x1780) && (address < 0x17c0)) {
-        riot003.ram[address - 0x1780] = value;
-    } else if ((address >= 0x17c0) && (address < 0x1800)) {
-        riot002.ram[address - 0x17c0] = value;
-    } else if ((address >= 0x1700) && (address < 0x1740)) {
-        riot003write(address, value);
-    } else if ((address >= 0x1740) && (address < 0x1780)) {
-        riot002write(address, value);
-    } else if (address < max_ram) {
-        ram[address] = value;
-    } else {
-        printf("Write %02x to %04x\n", value, address);
-    }
+            get_display_char(m->display[5]),
+            get_display_char(m->display[4]),
+            get_display_char(m->display[3]),
+            get_display_char(m->display[2]),
+            get_display_char(m->display[1]),
+            get_display_char(m->display[0]));
 }
 
-/* Handle reads from the 003 RIOT chip, which mostly do nothing */
-uint8_t riot003read(uint16_t address) {
-    if (address == 0x1700) {
-        return riot003.sad;
-    } else if (address == 0x1701) {
-        return riot003.padd;
-    } else if (address == 0x1702) {
-        return riot003.sad;
-    } else if (address == 0x1703) {
-        return riot003.pbdd;
-    } else if ((address == 0x1706) || (address == 0x170e)) {
-        if (riot003.timer.timeout) {
-            reset_timer(&riot003.timer, riot003.timer.timer_mult, riot003.timer.start_value);
-            riot003.timer.timeout = 0;
-            riot003.timer.timer_count = 255;
-            return 0;
-        } else {
-            return riot003.timer.timer_count;
-        }
-    } else if (address == 0x1707) {
-        if (riot003.timer.timeout) {
-            return 0x80;
-        } else {
-            return 0;
-        }
-    }
-}
-
-// key_bits holds the bit patterns for a key depressed on
-// each keyboard row (3 rows, 7 keys).
-uint8_t key_bits[7] = { 0xbf, 0xdf, 0xef, 0xf7, 0xfb, 0xfd, 0xfe };
-
-uint8_t riot002read(uint16_t address) {
-    uint8_t sv, nextval;
-    if (address == 0x1740) {
-        sv = (riot002.sbd >> 1) & 0xf;
-        // Return the correct key_bits if the current key depressed
-        // belongs to the right scan row, otherwise 0xff, meaning
-        // nothing on that row is depressed.
-        if (sv == 0) {
-            if (char_pending <= 6) {
-                return key_bits[char_pending];
-            } else {
-                return 0xff;
-            }
-        } else if (sv == 1) {
-            if ((char_pending >= 7) && (char_pending <= 13)) {
-                return key_bits[char_pending-7];
-            } else {
-                return 0xff;
-            }
-        } else if (sv == 2) {
-            if ((char_pending >= 14) && (char_pending <= 20)) {
-                return key_bits[char_pending-14];
-            } else {
-                return 0xff;
-            }
-        } else if (sv == 3) {
-            if (kim1_serial_mode) {
-                return 0;
-            }
-            return 0xff;
-        } else {
-            return 0x80;
-        }
-    } else if (address == 0x1741) {
-        return riot002.padd;
-    } else if (address == 0x1742) {
-        if (sending_serial) {
-            serial_out_bit_ready = 1;
-        }
-        return riot002.sbd;
-    } else if (address == 0x1743) {
-        return riot002.pbdd;
-    } else if ((address == 0x1746) || (address == 0x174e)) {
-        if (riot002.timer.timeout) {
-            reset_timer(&riot002.timer, riot002.timer.timer_mult, riot002.timer.start_value);
-            return 0;
-        } else {
-            return riot002.timer.timer_count;
-        }
-    } else if (address == 0x1747) {
-        if (riot002.timer.timeout) {
-            return 0x80;
-        } else {
-            return 0;
-        }
-    }
-    return 0;
-}
-
-void riot003write(uint16_t address, uint8_t value) {
-    switch (address) {
-        case 0x1700:
-            riot003.sad = value;
-            break;
-        
-        case 0x1701:
-            riot003.padd = value;
-            break;
-
-        case 0x1702:
-            riot003.sbd = value;
-            break;
-
-        case 0x1703:
-            riot003.pbdd = value;
-            break;
-
-        case 0x1704:
-            reset_timer(&riot003.timer, 1, value);
-            break;
-
-        case 0x1705:
-            reset_timer(&riot003.timer, 8, value);
-            break;
-
-        case 0x1706:
-            reset_timer(&riot003.timer, 64, value);
-            break;
-
-        case 0x1707:
-            reset_timer(&riot003.timer, 1024, value);
-            break;
-    }
-}
-
-void riot002write(uint16_t address, uint8_t value) {
-    switch (address) {
-        case 0x1740:
-            riot002.sad = value;
-            break;
-        
-        case 0x1741:
-            riot002.padd = value;
-            break;
-
-        case 0x1742:
-            riot002.sbd = value;
-            if (!sending_serial && ((value & 1) == 0)) {
-                sending_serial = 1;
-                serial_out_count = 0;
-                serial_out_byte = 0;
-                serial_out_bit_ready = 0;
-            } else if (sending_serial && serial_out_bit_ready) {
-                if (serial_out_count == 8) {
-                    if (writing_paper_tape) {
-                        if (serial_out_byte != 0) {
-                            fwrite(&serial_out_byte, 1, 1, paper_tape_file);
-                        }
-                    } else {
-                        printf("%c", serial_out_byte);
-                        fflush(stdout);
-                    }
-                    sending_serial = 0;
-                }
-                serial_out_byte = ((serial_out_byte >> 1) & 0x7f) | ((value & 1) << 7);
-                serial_out_count++;
-                serial_out_bit_ready = 0;
-            }
-            break;
-
-        case 0x1743:
-            riot002.pbdd = value;
-            break;
-
-        case 0x1744:
-            reset_timer(&riot002.timer, 1, value);
-            break;
-
-        case 0x1745:
-            reset_timer(&riot002.timer, 8, value);
-            break;
-
-        case 0x1746:
-            reset_timer(&riot002.timer, 64, value);
-            break;
-
-        case 0x1747:
-            reset_timer(&riot002.timer, 1024, value);
-            break;
-    }
-}
-
-#ifdef REAL_TIMER
-void reset_timer(TIMER *timer, int scale, uint8_t start_value) {
-    timer->timer_mult = scale;
-    timer->timeout = 0;
-    timer->start_value = start_value;
-    timer->timer_count = start_value;
-    timer->starttime = current_time_nanos();
-}
-
-// This assumes a 1-MHz clock speed for the 6530 chip
-
-void update_timer(TIMER *timer, uint32_t ticks) {
-    uint64_t curr_time = current_time_nanos();
-    if ((timer->timer_mult == 0) || timer->timeout) {
-        return;
-    }
-    if ((curr_time -timer->starttime)/ 1000 >= timer->start_value * timer->timer_mult) {
-        timer->timeout = 1;
-        timer->timer_count = 0;
-    } else {
-        timer->timer_count = timer->start_value - (curr_time - timer->starttime) / 1000;
-    }
-}
-
-#else
-void reset_timer(TIMER *timer, int scale, uint8_t start_value) {
-    timer->timer_mult = scale;
-    timer->tick_accum = 0;
-    timer->start_value = start_value;
-    timer->timer_count = start_value;
-    timer->timeout = 0;
-}
-
-// This assumes a 1-MHz clock speed for the 6530 chip (i.e. using the CPU ticks to
-// count down the timer).
-void update_timer(TIMER *timer, uint32_t ticks) {
-    int num_timer_ticks;
-    if (timer->timer_mult == 0) {
-        return;
-    }
-    if (timer->timeout) {
-        return;
-    }
-    timer->tick_accum += ticks;
-    if (timer->tick_accum > timer->timer_mult) {
-        num_timer_ticks = timer->tick_accum / timer->timer_mult;
-        if (timer->timer_mult == 1) {
-            timer->tick_accum = 0;
-        } else {
-            timer->tick_accum = timer->tick_accum % timer->timer_mult;
-        }
-        if (num_timer_ticks >= timer->timer_count) {
-            timer->timer_count = 0;
-            timer->timeout = 1;
-        } else {
-            timer->timer_count -= num_timer_ticks;
-        }
-    }
-}
-#endif
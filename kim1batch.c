@@ -0,0 +1,395 @@
+/* kim1-batch runs a list of KIM-1 programs headless, spread across a pool
+ * of worker threads. Each job gets its own KIM1Machine, so jobs never share
+ * any state and the pool scales with the number of cores.
+ *
+ * The manifest has one job per line:
+ *
+ *     binary  load-addr  entry-addr  cycles  [stdin-script]
+ *
+ * The addresses are hex, cycles is the cycle budget for the job and the
+ * optional stdin script is a file whose bytes are fed to the KIM-1 serial
+ * port. Blank lines and lines starting with # are ignored.
+ *
+ * With -snapshot, every job starts from the saved machine instead of a
+ * freshly reset one. A binary of - loads nothing and an entry of - leaves
+ * the pc where the snapshot had it.
+ *
+ * When every job has finished, one result line per job is written in
+ * manifest order with the final registers, cycles used, a hash of RAM and
+ * the serial output. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "kim1machine.h"
+#include "snapshot.h"
+#include "accel.h"
+
+typedef struct JOB {
+    char binary[1024];
+    char script[1024];
+    uint16_t load_addr;
+    uint16_t entry;
+    int has_entry;
+    uint64_t budget;
+
+    // Results
+    char *error;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint16_t pc;
+    uint8_t a, x, y, sp, status;
+    uint64_t ram_hash;
+    uint8_t *serial;
+    int serial_len;
+    int serial_size;
+} JOB;
+
+/* Each worker owns a deque of job numbers. A worker takes work from the
+ * bottom of its own deque and, once that is empty, steals from the top of
+ * the other workers' deques. */
+typedef struct WORKER {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int *jobs;
+    int top;
+    int bottom;
+} WORKER;
+
+JOB *jobs;
+int num_jobs;
+WORKER *workers;
+int num_workers;
+int max_ram = 1024;
+int fast_timers = 0;
+uint32_t accel = 0;
+// The machine from -snapshot, copied into each job's machine
+KIM1Machine *snapshot_machine;
+
+// Cycles to run between serial input top-ups
+#define JOB_SLICE 10000
+
+void serial_out_job(KIM1Machine *m, uint8_t b) {
+    JOB *job = (JOB *) m->user;
+    // Like the paper tape writer, drop the NULs the ROM echoes while
+    // it polls an idle serial line
+    if (b == 0) {
+        return;
+    }
+    if (job->serial_len == job->serial_size) {
+        job->serial_size = job->serial_size ? job->serial_size * 2 : 256;
+        job->serial = realloc(job->serial, job->serial_size);
+    }
+    job->serial[job->serial_len++] = b;
+}
+
+void run_job(JOB *job) {
+    KIM1Machine *m;
+    FILE *in;
+    uint8_t *script = NULL;
+    long script_len = 0, script_pos = 0;
+    uint32_t slice;
+    uint64_t start;
+    uint64_t start_instructions;
+
+    if ((m = malloc(sizeof(KIM1Machine))) == NULL) {
+        job->error = "out of memory";
+        return;
+    }
+    if (snapshot_machine) {
+        memcpy(m, snapshot_machine, sizeof(KIM1Machine));
+        build_memory_map(m);
+    } else {
+        kim1_init(m);
+        kim1_set_ram(m, max_ram);
+    }
+    m->auto_tape = 0;
+    m->kim1_serial_mode = 1;
+    m->fast_timers = fast_timers;
+    kim1_set_accel(m, accel);
+    m->serial_out = serial_out_job;
+    m->user = job;
+
+    if (strcmp(job->binary, "-")) {
+        if (job->load_addr >= m->max_ram) {
+            job->error = "load address is not in RAM";
+            free(m);
+            return;
+        }
+        if ((in = fopen(job->binary, "rb")) == NULL) {
+            job->error = "unable to open binary";
+            free(m);
+            return;
+        }
+        kim1_load_binary(m, in, job->load_addr);
+        fclose(in);
+    }
+
+    if (job->script[0]) {
+        if ((in = fopen(job->script, "rb")) == NULL) {
+            job->error = "unable to open stdin script";
+            free(m);
+            return;
+        }
+        fseek(in, 0, SEEK_END);
+        script_len = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        script = malloc(script_len > 0 ? script_len : 1);
+        script_len = fread(script, 1, script_len, in);
+        fclose(in);
+    }
+
+    if (job->has_entry) {
+        m->cpu.pc = job->entry;
+    }
+
+    start = kim1_cycles(m);
+    start_instructions = m->instructions_run;
+    while (job->cycles < job->budget) {
+        // Top up the serial input queue between slices
+        while ((script_pos < script_len) && !serial_in_queue_full(m)) {
+            serial_in_queue_put(m, script[script_pos++]);
+        }
+        slice = job->budget - job->cycles < JOB_SLICE ? job->budget - job->cycles : JOB_SLICE;
+        kim1_run(m, slice);
+        job->cycles = kim1_cycles(m) - start;
+    }
+
+    job->instructions = m->instructions_run - start_instructions;
+    job->pc = m->cpu.pc;
+    job->a = m->cpu.a;
+    job->x = m->cpu.x;
+    job->y = m->cpu.y;
+    job->sp = m->cpu.sp;
+    job->status = m->cpu.status;
+    job->ram_hash = kim1_ram_hash(m);
+
+    free(script);
+    free(m);
+}
+
+/* Take a job from the bottom of our own deque, or steal one from the top
+ * of another worker's. Returns -1 when there is no work left anywhere. */
+int next_job(int self) {
+    int job = -1;
+    WORKER *w = &workers[self];
+
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom > w->top) {
+        job = w->jobs[--w->bottom];
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (job >= 0) return job;
+
+    for (int i=1; i < num_workers; i++) {
+        w = &workers[(self + i) % num_workers];
+        pthread_mutex_lock(&w->lock);
+        if (w->bottom > w->top) {
+            job = w->jobs[w->top++];
+        }
+        pthread_mutex_unlock(&w->lock);
+        if (job >= 0) return job;
+    }
+    return -1;
+}
+
+void *worker_main(void *arg) {
+    int self = (int) (intptr_t) arg;
+    int job;
+
+    while ((job = next_job(self)) >= 0) {
+        run_job(&jobs[job]);
+    }
+    return NULL;
+}
+
+int read_manifest(char *filename) {
+    FILE *in;
+    char line[4096], *p;
+    char load[64], entry[64];
+    unsigned long long budget;
+    int size = 0, n, lineno = 0;
+
+    if ((in = fopen(filename, "r")) == NULL) {
+        perror(filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        lineno++;
+        for (p = line; isspace(*p); p++);
+        if ((*p == 0) || (*p == '#')) continue;
+
+        if (num_jobs == size) {
+            size = size ? size * 2 : 64;
+            jobs = realloc(jobs, size * sizeof(JOB));
+        }
+        memset(&jobs[num_jobs], 0, sizeof(JOB));
+        n = sscanf(p, "%1023s %63s %63s %llu %1023s", jobs[num_jobs].binary, load, entry,
+                &budget, jobs[num_jobs].script);
+        if (n < 4) {
+            fprintf(stderr, "%s:%d: expected binary, load address, entry address and cycles\n",
+                    filename, lineno);
+            fclose(in);
+            return -1;
+        }
+        jobs[num_jobs].load_addr = strtoul(load, NULL, 16) & 0xffff;
+        jobs[num_jobs].entry = strtoul(entry, NULL, 16) & 0xffff;
+        jobs[num_jobs].has_entry = strcmp(entry, "-") != 0;
+        jobs[num_jobs].budget = budget;
+        num_jobs++;
+    }
+    fclose(in);
+    return 0;
+}
+
+void write_result(FILE *out, int n, JOB *job) {
+    fprintf(out, "job=%d binary=%s", n, job->binary);
+    if (job->error) {
+        fprintf(out, " error=\"%s\"\n", job->error);
+        return;
+    }
+    fprintf(out, " pc=%04x a=%02x x=%02x y=%02x sp=%02x status=%02x cycles=%llu instructions=%llu ram=%016llx serial=\"",
+            job->pc, job->a, job->x, job->y, job->sp, job->status,
+            (unsigned long long) job->cycles, (unsigned long long) job->instructions, (unsigned long long) job->ram_hash);
+    for (int i=0; i < job->serial_len; i++) {
+        uint8_t b = job->serial[i];
+        if ((b == '"') || (b == '\\')) {
+            fprintf(out, "\\%c", b);
+        } else if ((b >= 0x20) && (b < 0x7f)) {
+            fputc(b, out);
+        } else {
+            fprintf(out, "\\x%02x", b);
+        }
+    }
+    fprintf(out, "\"\n");
+}
+
+void usage() {
+    printf("Usage:  kim1-batch [-ram size] [-threads n] [-o results] [-snapshot file]\n");
+    printf("                   [-fast-timers] [-accel list] manifest\n");
+    printf("  where size = 1k, 2k, 3k, 4k, 5k or full, and each manifest line is\n");
+    printf("  binary load-addr entry-addr cycles [stdin-script]\n");
+}
+
+int main(int argc, char *argv[]) {
+    char *manifest = NULL;
+    char *results = NULL;
+    char *snapshot = NULL;
+    FILE *out = stdout;
+
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i=1; i < argc; i++) {
+        if (!strcmp(argv[i], "-ram") || !strcmp(argv[i], "--ram")) {
+            if (i >= argc-1) {
+                printf("Must specify ram size (1k,2k,3k,4k,5k or full)\n");
+                exit(1);
+            }
+            if (!strcmp(argv[i+1], "full")) {
+                max_ram = 65536;
+            } else if (isdigit(argv[i+1][0]) && (argv[i+1][1] == 'k' || (argv[i+1][1] == 'K'))) {
+                int ram_size = argv[i+1][0] - '0';
+                if ((ram_size < 1) || (ram_size > 5)) {
+                    printf("Ram size must be between 1k and 5k\n");
+                    exit(1);
+                }
+                max_ram = 1024 * ram_size;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-threads")) {
+            if (i >= argc-1) {
+                usage();
+                exit(1);
+            }
+            num_workers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-snapshot")) {
+            if (i >= argc-1) {
+                usage();
+                exit(1);
+            }
+            snapshot = argv[++i];
+        } else if (!strcmp(argv[i], "-fast-timers")) {
+            fast_timers = 1;
+        } else if (!strcmp(argv[i], "-accel")) {
+            if ((i >= argc-1) || (accel_parse(argv[i+1], &accel) < 0)) {
+                usage();
+                exit(1);
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-o")) {
+            if (i >= argc-1) {
+                usage();
+                exit(1);
+            }
+            results = argv[++i];
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-help") ||
+            !strcmp(argv[i], "--h") || !strcmp(argv[i], "--help")) {
+            usage();
+            exit(0);
+        } else {
+            manifest = argv[i];
+        }
+    }
+    if (manifest == NULL) {
+        usage();
+        exit(1);
+    }
+    if (num_workers < 1) {
+        num_workers = 1;
+    }
+
+    if (read_manifest(manifest) < 0) {
+        exit(1);
+    }
+    if (num_workers > num_jobs) {
+        num_workers = num_jobs > 0 ? num_jobs : 1;
+    }
+
+    load_roms();
+
+    if (snapshot) {
+        snapshot_machine = malloc(sizeof(KIM1Machine));
+        kim1_init(snapshot_machine);
+        if (snapshot_load(snapshot_machine, snapshot) < 0) {
+            fprintf(stderr, "Unable to load snapshot %s\n", snapshot);
+            exit(1);
+        }
+    }
+
+    // Deal the jobs out round-robin, stealing evens out the rest
+    workers = calloc(num_workers, sizeof(WORKER));
+    for (int i=0; i < num_workers; i++) {
+        pthread_mutex_init(&workers[i].lock, NULL);
+        workers[i].jobs = malloc((num_jobs / num_workers + 1) * sizeof(int));
+    }
+    for (int i=0; i < num_jobs; i++) {
+        WORKER *w = &workers[i % num_workers];
+        w->jobs[w->bottom++] = i;
+    }
+
+    for (int i=0; i < num_workers; i++) {
+        pthread_create(&workers[i].thread, NULL, worker_main, (void *) (intptr_t) i);
+    }
+    for (int i=0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    if (results && ((out = fopen(results, "w")) == NULL)) {
+        perror(results);
+        exit(1);
+    }
+    for (int i=0; i < num_jobs; i++) {
+        write_result(out, i, &jobs[i]);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    for (int i=0; i < num_jobs; i++) {
+        if (jobs[i].error) exit(1);
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+/* kim1-bench runs a fixed set of workloads on a complete KIM-1, headless
+ * and unthrottled, and writes the results as JSON:
+ *
+ *   alu      a tight loop of loads, stores, ADC, EOR, shifts and JSR/RTS
+ *   memcpy   copying three pages with (zp),Y loads and stores
+ *   bcd      decimal mode ADC and SBC on multi-byte counters
+ *   keyscan  the ROM monitor idling in its keyboard scan and display loop
+ *   tape     the ROM's paper tape loader reading tapes through GETCH
+ *
+ * For each it reports emulated MHz, host ns per instruction and the read
+ * and write system calls made per emulated second. It is built once with
+ * each CPU core, like bench6502, so the two can be compared. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "kim1machine.h"
+#include "metrics.h"
+
+// Cycles to run each workload for, unless given on the command line
+#define BENCH_CYCLES 50000000
+// Cycles between serial input top-ups for the tape workload
+#define TAPE_REFILL_CYCLES 5000
+
+typedef struct WORKLOAD {
+    char *name;
+    void (*setup)(KIM1Machine *m);
+} WORKLOAD;
+
+uint8_t alu_code[] = {
+    0xa2, 0x00,             // 0200 LDX #$00
+    0xa0, 0x00,             // 0202 LDY #$00
+    0xb9, 0x00, 0x03,       // 0204 LDA $0300,Y
+    0x18,                   // 0207 CLC
+    0x69, 0x07,             // 0208 ADC #$07
+    0x99, 0x00, 0x04,       // 020a STA $0400,Y
+    0x45, 0x10,             // 020d EOR $10
+    0x85, 0x10,             // 020f STA $10
+    0x0a,                   // 0211 ASL A
+    0xc8,                   // 0212 INY
+    0xd0, 0xef,             // 0213 BNE $0204
+    0xe8,                   // 0215 INX
+    0x20, 0x1c, 0x02,       // 0216 JSR $021C
+    0x4c, 0x02, 0x02,       // 0219 JMP $0202
+    0x48,                   // 021c PHA
+    0x68,                   // 021d PLA
+    0x60,                   // 021e RTS
+};
+
+uint8_t memcpy_code[] = {
+    0xa9, 0x00,             // 0200 LDA #$00
+    0x85, 0xf0,             // 0202 STA $F0
+    0x85, 0xf2,             // 0204 STA $F2
+    0xa9, 0x03,             // 0206 LDA #$03
+    0x85, 0xf1,             // 0208 STA $F1
+    0xa9, 0x06,             // 020a LDA #$06
+    0x85, 0xf3,             // 020c STA $F3
+    0xa2, 0x03,             // 020e LDX #$03
+    0xa0, 0x00,             // 0210 LDY #$00
+    0xb1, 0xf0,             // 0212 LDA ($F0),Y
+    0x91, 0xf2,             // 0214 STA ($F2),Y
+    0xc8,                   // 0216 INY
+    0xd0, 0xf9,             // 0217 BNE $0212
+    0xe6, 0xf1,             // 0219 INC $F1
+    0xe6, 0xf3,             // 021b INC $F3
+    0xca,                   // 021d DEX
+    0xd0, 0xf2,             // 021e BNE $0212
+    0x4c, 0x00, 0x02,       // 0220 JMP $0200
+};
+
+uint8_t bcd_code[] = {
+    0xf8,                   // 0200 SED
+    0x18,                   // 0201 CLC
+    0xa5, 0x10,             // 0202 LDA $10
+    0x69, 0x01,             // 0204 ADC #$01
+    0x85, 0x10,             // 0206 STA $10
+    0xa5, 0x11,             // 0208 LDA $11
+    0x69, 0x00,             // 020a ADC #$00
+    0x85, 0x11,             // 020c STA $11
+    0xa5, 0x12,             // 020e LDA $12
+    0x69, 0x00,             // 0210 ADC #$00
+    0x85, 0x12,             // 0212 STA $12
+    0x38,                   // 0214 SEC
+    0xa5, 0x20,             // 0215 LDA $20
+    0xe9, 0x01,             // 0217 SBC #$01
+    0x85, 0x20,             // 0219 STA $20
+    0xa5, 0x21,             // 021b LDA $21
+    0xe9, 0x00,             // 021d SBC #$00
+    0x85, 0x21,             // 021f STA $21
+    0x4c, 0x01, 0x02,       // 0221 JMP $0201
+};
+
+FILE *devnull;
+
+// The tape workload's input, an L command and a tape, sent over and over
+char tape_text[8192];
+int tape_len;
+int tape_pos;
+
+void serial_out_bench(KIM1Machine *m, uint8_t b) {
+    putc(b, devnull);
+}
+
+void load_code(KIM1Machine *m, uint8_t *code, int len) {
+    for (int i=0; i < 256; i++) {
+        m->ram[0x300 + i] = (uint8_t) (i * 37);
+    }
+    memcpy(&m->ram[0x200], code, len);
+    m->cpu.pc = 0x200;
+}
+
+void setup_alu(KIM1Machine *m) {
+    load_code(m, alu_code, sizeof(alu_code));
+}
+
+void setup_memcpy(KIM1Machine *m) {
+    load_code(m, memcpy_code, sizeof(memcpy_code));
+}
+
+void setup_bcd(KIM1Machine *m) {
+    load_code(m, bcd_code, sizeof(bcd_code));
+}
+
+void setup_keyscan(KIM1Machine *m) {
+    // Just the monitor after a reset, with no keys down
+}
+
+/* Build an L command followed by a tape of 16 records of 24 bytes */
+void make_tape() {
+    uint16_t addr = 0x200, sum;
+    int records = 16, count = 24;
+    uint8_t b;
+
+    tape_len = sprintf(tape_text, "L");
+    for (int r=0; r < records; r++, addr += count) {
+        sum = count + (addr >> 8) + (addr & 0xff);
+        tape_len += sprintf(tape_text + tape_len, ";%02X%04X", count, addr);
+        for (int i=0; i < count; i++) {
+            b = (uint8_t) (r * 31 + i * 7);
+            sum += b;
+            tape_len += sprintf(tape_text + tape_len, "%02X", b);
+        }
+        tape_len += sprintf(tape_text + tape_len, "%04X\r\n", sum);
+    }
+    tape_len += sprintf(tape_text + tape_len, ";00%04X%04X\r\n", records, records);
+}
+
+void tape_refill_event(KIM1Machine *m) {
+    while (!serial_in_queue_full(m)) {
+        serial_in_queue_put(m, tape_text[tape_pos]);
+        tape_pos = (tape_pos + 1) % tape_len;
+    }
+    kim1_schedule(m, kim1_cycles(m) + TAPE_REFILL_CYCLES, tape_refill_event);
+}
+
+void setup_tape(KIM1Machine *m) {
+    // The ROM comes up in TTY mode and reads the tapes a character at a
+    // time, there is no tape_prompt so nothing is loaded natively
+    m->kim1_serial_mode = 1;
+    make_tape();
+    tape_pos = 0;
+    serial_in_queue_put(m, '\r');
+    tape_refill_event(m);
+}
+
+WORKLOAD workloads[] = {
+    { "alu", setup_alu },
+    { "memcpy", setup_memcpy },
+    { "bcd", setup_bcd },
+    { "keyscan", setup_keyscan },
+    { "tape", setup_tape },
+};
+
+double now_seconds() {
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t cycles = BENCH_CYCLES;
+    int num_workloads = sizeof(workloads) / sizeof(WORKLOAD);
+    KIM1Machine *m = malloc(sizeof(KIM1Machine));
+    uint64_t start_cycles, run_cycles;
+    uint32_t start_instructions, instructions;
+    long start_syscalls, end_syscalls, overhead;
+    double start, elapsed;
+
+    if (argc > 1) {
+        cycles = strtoull(argv[1], NULL, 0);
+    }
+    if ((devnull = fopen("/dev/null", "w")) == NULL) {
+        perror("/dev/null");
+        exit(1);
+    }
+    load_roms();
+
+    // What reading /proc/self/io costs in system calls itself
+    start_syscalls = metrics_syscalls();
+    overhead = metrics_syscalls() - start_syscalls;
+
+    printf("{\n  \"core\": \"%s\",\n  \"cycles\": %llu,\n  \"workloads\": [\n",
+            core6502, (unsigned long long) cycles);
+    for (int i=0; i < num_workloads; i++) {
+        kim1_init(m);
+        kim1_set_ram(m, 4096);
+        m->auto_tape = 0;
+        m->serial_out = serial_out_bench;
+        workloads[i].setup(m);
+
+        start_cycles = kim1_cycles(m);
+        start_instructions = m->cpu.instructions;
+        start_syscalls = metrics_syscalls();
+        start = now_seconds();
+        while (kim1_cycles(m) - start_cycles < cycles) {
+            kim1_run(m, 100000);
+        }
+        elapsed = now_seconds() - start;
+        end_syscalls = metrics_syscalls();
+        run_cycles = kim1_cycles(m) - start_cycles;
+        instructions = m->cpu.instructions - start_instructions;
+
+        printf("    { \"name\": \"%s\", \"cycles\": %llu, \"instructions\": %u, \"seconds\": %.6f, "
+                "\"emulated_mhz\": %.2f, \"ns_per_instruction\": %.3f, \"syscalls_per_emulated_second\": ",
+                workloads[i].name, (unsigned long long) run_cycles, instructions, elapsed,
+                run_cycles / elapsed / 1e6, elapsed * 1e9 / instructions);
+        if ((start_syscalls < 0) || (end_syscalls < 0)) {
+            printf("null");
+        } else {
+            printf("%.2f", (end_syscalls - start_syscalls - overhead) / (run_cycles / 1e6));
+        }
+        printf(" }%s\n", i < num_workloads - 1 ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
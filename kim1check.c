@@ -0,0 +1,366 @@
+/* kim1-check runs the emulator's self-checks, kept out of kim1 itself:
+ *
+ * Every decimal mode ADC and SBC immediate, on each accumulator, operand
+ * and carry. The accumulator, flags and cycles must match the NMOS 6502's
+ * decimal arithmetic, worked out here directly, and the parts of the
+ * result the BCD tables didn't mean to change (Z for ADC, N, V and Z for
+ * SBC, and the cycles) must also match the nibble adjust the core used
+ * before them.
+ *
+ * Each ROM accelerator against the ROM itself, on the given number of
+ * random machine states (1000 by default).
+ *
+ * Pokes and loads into RAM around rewind checkpoints, which a rewind must
+ * all undo.
+ *
+ * Like the benchmarks it is built once for each core, kim1-check and
+ * kim1-check-table, and make check runs both. The exit status is 1 if
+ * anything didn't match. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "kim1machine.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "accel.h"
+
+/* Decimal mode ADC or SBC the way the core did it before the tables, for
+ * check_bcd. Returns the accumulator in the low byte and the flags in the
+ * high byte. */
+uint16_t bcd_old(uint8_t a, uint8_t value, uint8_t status, int sbc) {
+    uint16_t v = sbc ? value ^ 0xff : value;
+    uint16_t result = a + v + (status & FLAG_CARRY);
+
+    status &= ~(FLAG_CARRY | FLAG_ZERO | FLAG_OVERFLOW | FLAG_SIGN);
+    if (!(result & 0xff)) status |= FLAG_ZERO;
+    if ((result ^ a) & (result ^ v) & 0x80) status |= FLAG_OVERFLOW;
+    if (result & 0x80) status |= FLAG_SIGN;
+
+    if (sbc) {
+        result -= 0x66;
+    }
+    if ((result & 0x0f) > 0x09) {
+        result += 0x06;
+    }
+    if ((result & 0xf0) > 0x90) {
+        result += 0x60;
+        status |= FLAG_CARRY;
+    }
+    return (result & 0xff) | (status << 8);
+}
+
+/* Decimal mode ADC or SBC as the NMOS 6502 does it, following Bruce
+ * Clark's description in "Decimal Mode" on 6502.org, in the same form as
+ * bcd_old */
+uint16_t bcd_nmos(uint8_t a, uint8_t value, uint8_t status, int sbc) {
+    int carry = status & FLAG_CARRY;
+    int binary, low, result;
+
+    status &= ~(FLAG_CARRY | FLAG_ZERO | FLAG_OVERFLOW | FLAG_SIGN);
+    if (sbc) {
+        // Every flag comes from the binary subtraction
+        binary = a - value - !carry;
+        if (!(binary & 0xff)) status |= FLAG_ZERO;
+        if ((a ^ value) & (a ^ binary) & 0x80) status |= FLAG_OVERFLOW;
+        if (binary & 0x80) status |= FLAG_SIGN;
+        if (binary >= 0) status |= FLAG_CARRY;
+
+        low = (a & 0x0f) - (value & 0x0f) + carry - 1;
+        if (low < 0) {
+            low = ((low - 0x06) & 0x0f) - 0x10;
+        }
+        result = (a & 0xf0) - (value & 0xf0) + low;
+        if (result < 0) {
+            result -= 0x60;
+        }
+    } else {
+        // Z from the binary sum, N and V from the sum with only the low
+        // digit adjusted, as signed numbers
+        if (!((a + value + carry) & 0xff)) status |= FLAG_ZERO;
+        low = (a & 0x0f) + (value & 0x0f) + carry;
+        if (low >= 0x0a) {
+            low = ((low + 0x06) & 0x0f) + 0x10;
+        }
+        result = (int8_t) (a & 0xf0) + (int8_t) (value & 0xf0) + low;
+        if ((result < -128) || (result > 127)) status |= FLAG_OVERFLOW;
+        if (result & 0x80) status |= FLAG_SIGN;
+
+        result = (a & 0xf0) + (value & 0xf0) + low;
+        if (result >= 0xa0) {
+            result += 0x60;
+        }
+        if (result >= 0x100) status |= FLAG_CARRY;
+    }
+    return (result & 0xff) | (status << 8);
+}
+
+/* Check every decimal ADC and SBC, 131072 of each, returning the number
+ * that don't match */
+int check_bcd() {
+    KIM1Machine *m = malloc(sizeof(KIM1Machine));
+    CPU6502 *c = &m->cpu;
+    uint16_t want, old;
+    uint8_t keep;
+    uint32_t start;
+    int failed = 0, changed = 0;
+
+    kim1_init(m);
+    kim1_set_ram(m, 1024);
+    for (int sbc=0; sbc < 2; sbc++) {
+        // The flags the tables weren't meant to change from the old adjust
+        keep = sbc ? FLAG_ZERO | FLAG_OVERFLOW | FLAG_SIGN : FLAG_ZERO;
+        for (int carry=0; carry < 2; carry++) {
+            for (int a=0; a < 256; a++) {
+                for (int v=0; v < 256; v++) {
+                    m->ram[0x200] = sbc ? 0xe9 : 0x69;
+                    m->ram[0x201] = v;
+                    c->pc = 0x200;
+                    c->a = a;
+                    c->status = FLAG_CONSTANT | FLAG_DECIMAL | carry;
+                    start = c->clockticks6502;
+                    step6502(c);
+
+                    want = bcd_nmos(a, v, FLAG_CONSTANT | FLAG_DECIMAL | carry, sbc);
+                    old = bcd_old(a, v, FLAG_CONSTANT | FLAG_DECIMAL | carry, sbc);
+                    if ((c->a != (want & 0xff)) || (c->status != (want >> 8)) ||
+                            (c->clockticks6502 - start != 3)) {
+                        if (failed++ < 10) {
+                            printf("%s %02x,%02x carry %d: a=%02x p=%02x cycles=%u, expected a=%02x p=%02x cycles=3\n",
+                                    sbc ? "SBC" : "ADC", a, v, carry, c->a, c->status,
+                                    c->clockticks6502 - start, want & 0xff, want >> 8);
+                        }
+                    }
+                    if ((c->status & keep) != ((old >> 8) & keep)) {
+                        if (changed++ < 10) {
+                            printf("%s %02x,%02x carry %d: p=%02x, the old adjust gave p=%02x\n",
+                                    sbc ? "SBC" : "ADC", a, v, carry, c->status, old >> 8);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("%s core: 262144 decimal ADC/SBC checked, %d mismatches with the NMOS 6502,"
+            " %d unexpected changes from the old adjust\n", core6502, failed, changed);
+    free(m);
+    return failed + changed;
+}
+
+/* Poke and load into RAM around checkpoints, the way the front end and
+ * the ROM traps do, then rewind and make sure RAM and the registers are
+ * back as they were. Returns the number of mismatches. */
+int check_rewind() {
+    KIM1Machine *m = malloc(sizeof(KIM1Machine));
+    uint8_t *ram = malloc(sizeof(m->ram));
+    static char tape[] = ";030300010203000C\n;0000010001\n";
+    static uint8_t binary[600];
+    SNAPSHOT before, after;
+    FILE *in;
+    int failed = 0;
+
+    kim1_init(m);
+    kim1_set_ram(m, 5 * 1024);
+    // OUTCH's output isn't wanted
+    m->serial_out = NULL;
+    for (int i=0; i < (int) sizeof(binary); i++) {
+        binary[i] = i * 7 + 1;
+    }
+
+    rewind_start(m, 10);
+    kim1_run(m, 50000);
+    rewind_checkpoint(m);
+    memcpy(ram, m->ram, sizeof(m->ram));
+    snapshot_capture(m, &before);
+
+    // A poke and a binary load on pages the ROM never writes, a tape
+    // load's zero page pointers and OUTCH's bytes, either side of the
+    // next scheduled checkpoint
+    kim1_poke(m, 0x0200, 0x55);
+    if ((in = tmpfile()) != NULL) {
+        fwrite(binary, 1, sizeof(binary), in);
+        rewind(in);
+        kim1_load_binary(m, in, 0x0280);
+        fclose(in);
+    }
+    kim1_run(m, 80000);
+    if ((in = tmpfile()) != NULL) {
+        fputs(tape, in);
+        rewind(in);
+        if (kim1_load_tape(m, in) != TAPE_OK) {
+            printf("rewind check: tape didn't load\n");
+            failed++;
+        }
+        fclose(in);
+    }
+    outch(m);
+    kim1_poke(m, 0x0201, 0xaa);
+    kim1_run(m, 10000);
+
+    rewind_back(m, (double) (kim1_cycles(m) - before.cycles) / 1000000);
+    snapshot_capture(m, &after);
+
+    for (int i=0; i < m->max_ram; i++) {
+        if (m->ram[i] != ram[i]) {
+            printf("rewind check: %04x is %02x, was %02x\n", i, m->ram[i], ram[i]);
+            failed++;
+        }
+    }
+    if ((after.cycles != before.cycles) || (after.pc != before.pc) ||
+            (after.a != before.a) || (after.x != before.x) || (after.y != before.y) ||
+            (after.sp != before.sp) || (after.status != before.status)) {
+        printf("rewind check: registers differ\n");
+        failed++;
+    }
+    printf("rewind %d mismatches\n", failed);
+    free(ram);
+    free(m);
+    return failed;
+}
+
+/* The differential check. Two machines are set up in the same random
+ * state with a JSR to the routine at 0200, one with the accelerator on
+ * and one without, run until the routine returns and compared. */
+
+typedef struct CHECK_OUTPUT {
+    uint8_t buf[16];
+    int len;
+} CHECK_OUTPUT;
+
+void check_serial_out(KIM1Machine *m, uint8_t b) {
+    CHECK_OUTPUT *out = (CHECK_OUTPUT *) m->user;
+
+    if (out->len < (int) sizeof(out->buf)) {
+        out->buf[out->len++] = b;
+    }
+}
+
+void check_return_trap(KIM1Machine *m) {
+    kim1_stop(m);
+}
+
+static uint32_t check_random(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+void check_setup(KIM1Machine *m, CHECK_OUTPUT *out, ACCEL *a, uint32_t seed, int on) {
+    CPU6502 *c = &m->cpu;
+    static char hex[] = "0123456789ABCDEF/:@G";
+
+    kim1_init(m);
+    kim1_set_ram(m, 65536);
+    memset(out, 0, sizeof(*out));
+    m->serial_out = check_serial_out;
+    m->user = out;
+
+    for (int i=0; i < 0x400; i++) {
+        m->ram[i] = check_random(&seed);
+    }
+    c->a = check_random(&seed);
+    // Mostly hex digits for PACK
+    if (check_random(&seed) & 1) {
+        c->a = hex[check_random(&seed) % (sizeof(hex) - 1)];
+    }
+    c->x = check_random(&seed);
+    c->y = check_random(&seed);
+    c->sp = check_random(&seed);
+    c->status = (check_random(&seed) | FLAG_CONSTANT) & ~FLAG_BREAK;
+    // Decimal mode only leaves it to the ROM, so don't waste many trials
+    if (check_random(&seed) & 7) {
+        c->status &= ~FLAG_DECIMAL;
+    }
+    m->char_pending = check_random(&seed) % 0x16;
+    m->kim1_serial_mode = check_random(&seed) & 1;
+    m->riot002.sad = check_random(&seed);
+    m->riot002.sbd = check_random(&seed) | 1;
+    m->riot002.padd = check_random(&seed);
+
+    m->ram[0x200] = 0x20;
+    m->ram[0x201] = a->addr & 0xff;
+    m->ram[0x202] = a->addr >> 8;
+    // A trap that returns doesn't run the traps where it returns to, so
+    // the stop goes after a NOP
+    m->ram[0x203] = 0xea;
+    c->pc = 0x200;
+    kim1_add_trap(m, 0x204, check_return_trap);
+    kim1_set_accel(m, on ? a->flag : 0);
+}
+
+char *check_compare(KIM1Machine *r, KIM1Machine *n, CHECK_OUTPUT *ro, CHECK_OUTPUT *no) {
+    if (!r->stopped || !n->stopped) return "didn't return";
+    if (r->cpu.a != n->cpu.a) return "a";
+    if (r->cpu.x != n->cpu.x) return "x";
+    if (r->cpu.y != n->cpu.y) return "y";
+    if (r->cpu.sp != n->cpu.sp) return "sp";
+    if (r->cpu.status != n->cpu.status) return "status";
+    if (kim1_cycles(r) != kim1_cycles(n)) return "cycles";
+    if (r->cpu.instructions != n->cpu.instructions) return "instructions";
+    if (memcmp(r->ram, n->ram, sizeof(r->ram))) return "ram";
+    if (memcmp(r->riot002.ram, n->riot002.ram, sizeof(r->riot002.ram)) ||
+            memcmp(r->riot003.ram, n->riot003.ram, sizeof(r->riot003.ram))) return "riot ram";
+    if ((r->riot002.sad != n->riot002.sad) || (r->riot002.padd != n->riot002.padd) ||
+            (r->riot002.sbd != n->riot002.sbd) || (r->riot002.pbdd != n->riot002.pbdd)) return "ports";
+    if (memcmp(r->display, n->display, sizeof(r->display))) return "display";
+    if (r->char_pending != n->char_pending) return "char_pending";
+    if ((ro->len != no->len) || memcmp(ro->buf, no->buf, ro->len)) return "serial output";
+    return NULL;
+}
+
+/* Run each accelerator against the ROM on the given number of random
+ * states, print a line for each and return the number of mismatches */
+int check_accel(int trials) {
+    KIM1Machine *r = malloc(sizeof(KIM1Machine));
+    KIM1Machine *n = malloc(sizeof(KIM1Machine));
+    CHECK_OUTPUT ro, no;
+    uint32_t seed = 0x4b494d31;
+    int failed = 0, bad;
+    char *what;
+
+    for (int i=0; i < num_accels; i++) {
+        bad = 0;
+        for (int t=0; t < trials; t++) {
+            check_random(&seed);
+            check_setup(r, &ro, &accels[i], seed, 0);
+            check_setup(n, &no, &accels[i], seed, 1);
+            for (int j=0; (j < 100) && !r->stopped; j++) kim1_run(r, 1000);
+            for (int j=0; (j < 100) && !n->stopped; j++) kim1_run(n, 1000);
+            if ((what = check_compare(r, n, &ro, &no)) != NULL) {
+                if (!bad) {
+                    printf("%s: %s differs, rom a=%02x x=%02x y=%02x p=%02x cycles=%llu,"
+                            " native a=%02x x=%02x y=%02x p=%02x cycles=%llu\n",
+                            accels[i].name, what, r->cpu.a, r->cpu.x, r->cpu.y, r->cpu.status,
+                            (unsigned long long) kim1_cycles(r), n->cpu.a, n->cpu.x, n->cpu.y,
+                            n->cpu.status, (unsigned long long) kim1_cycles(n));
+                }
+                bad++;
+            }
+        }
+        printf("%-8s %d trials, %d mismatches\n", accels[i].name, trials, bad);
+        failed += bad;
+    }
+    free(r);
+    free(n);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    int trials = 1000;
+    int failed = 0;
+
+    if (argc > 1) {
+        trials = atoi(argv[1]);
+        if ((argc > 2) || !isdigit(argv[1][0]) || (trials == 0)) {
+            printf("Usage:  kim1-check [accel trials]\n");
+            return 1;
+        }
+    }
+    load_roms();
+    failed += check_bcd();
+    failed += check_accel(trials);
+    failed += check_rewind();
+    return failed ? 1 : 0;
+}
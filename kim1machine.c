@@ -0,0 +1,1264 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <memory.h>
+#include "kim1machine.h"
+#include "profile.h"
+#include "trace.h"
+
+// The ROM images are read once and copied into every machine
+uint8_t rom002[1024];
+uint8_t rom003[1024];
+
+void load_roms() {
+    FILE *in;
+
+    if ((in = fopen("6530-002.bin", "rb")) == NULL) {
+        fprintf(stderr, "Can't open 6530-002.bin\n");
+        exit(1);
+    }
+    fread(rom002, 1, sizeof(rom002), in);
+    fclose(in);
+
+    if ((in = fopen("6530-003.bin", "rb")) == NULL) {
+        fprintf(stderr, "Can't open 6530-002.bin\n");
+        exit(1);
+    }
+    fread(rom003, 1, sizeof(rom003), in);
+    fclose(in);
+
+}
+
+/* Put a machine into its power-on state. load_roms must have been
+ * called first. Options such as auto_tape are reset to their defaults,
+ * so set them after calling this, and use kim1_set_ram to change the
+ * RAM size. */
+void kim1_init(KIM1Machine *m) {
+    memset(m, 0, sizeof(KIM1Machine));
+
+    m->max_ram = 1024;
+    m->auto_tape = 1;
+    m->serial_out = serial_out_stdout;
+    m->fast_tty = 1;
+
+    memcpy(m->riot002.rom, rom002, sizeof(rom002));
+    memcpy(m->riot003.rom, rom003, sizeof(rom003));
+    build_memory_map(m);
+
+    // No character pending
+    m->char_pending = 0x15;
+
+    // Set the vectors that the KIM-1 ROM uses
+    write6502(&m->cpu, 0x17fa, 0);
+    write6502(&m->cpu, 0x17fb, 0x1c);
+    write6502(&m->cpu, 0x17fe, 0);
+    write6502(&m->cpu, 0x17ff, 0x1c);
+
+    // Trap the ROM's display, keyboard, serial and paper tape routines
+    kim1_add_trap(m, 0x1f56, display_trap);
+    kim1_add_trap(m, 0x1f79, key_read_trap);
+    kim1_add_trap(m, 0x1f90, key_read_trap);
+    kim1_add_trap(m, 0x1e5a, getch_trap);
+    kim1_add_trap(m, 0x1e04, tape_load_trap);
+    kim1_add_trap(m, 0x1e01, tape_dump_trap);
+    kim1_add_trap(m, 0x1d77, tape_saved_trap);
+    kim1_add_trap(m, 0x1ea0, outch_trap);
+    kim1_add_trap(m, 0x1c31, detcps_trap);
+    kim1_add_trap(m, 0x1c7c, key_wait_trap);
+
+    // Reset the CPU
+    reset6502(&m->cpu);
+    hookexternal(&m->cpu, kim1_instruction_hook);
+}
+
+/* FNV-1a hash of the machine's RAM, used to compare end states of runs */
+uint64_t kim1_ram_hash(KIM1Machine *m) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i=0; i < m->max_ram; i++) {
+        hash = (hash ^ m->ram[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* Read memory without any of the side effects of a read6502, for
+ * disassembly. The RIOT I/O registers read as 0. */
+uint8_t kim1_peek(KIM1Machine *m, uint16_t addr) {
+    uint8_t *page = m->cpu.readmap[addr >> 8];
+
+    if ((page == NULL) && (m->watch_pages[addr >> 8] & WATCH_READ)) {
+        page = m->watch_readmap[addr >> 8];
+    }
+    if (page) {
+        return page[addr & 0xff];
+    }
+    if ((addr >= 0x1780) && (addr < 0x1800)) {
+        return io_read(m, addr);
+    }
+    return 0;
+}
+
+/* Store a byte in RAM from outside the CPU: a load, a poke from the host,
+ * or a trap doing what the ROM would. A page being watched for rewind is
+ * saved first, just as a CPU write to it would be. Addresses that aren't
+ * RAM are ignored. */
+void kim1_poke(KIM1Machine *m, uint16_t addr, uint8_t value) {
+    if (addr >= m->max_ram) {
+        return;
+    }
+    if (m->watched_pages[addr >> 8]) {
+        ram_page_written(m, addr >> 8);
+    }
+    m->ram[addr] = value;
+}
+
+/* Load a binary file into RAM at addr, stopping at the top of RAM.
+ * Returns the number of bytes loaded. */
+int kim1_load_binary(KIM1Machine *m, FILE *in, uint16_t addr) {
+    uint8_t buf[256];
+    int len = 0, n;
+
+    while ((addr + len < m->max_ram) && ((n = fread(buf, 1, sizeof(buf), in)) > 0)) {
+        for (int i=0; (i < n) && (addr + len < m->max_ram); i++, len++) {
+            kim1_poke(m, addr + len, buf[i]);
+        }
+    }
+    return len;
+}
+
+/* The default serial sink. Output is buffered, and only flushed here at
+ * the end of a line when the flush policy asks for it. */
+void serial_out_stdout(KIM1Machine *m, uint8_t b) {
+    putchar(b);
+    if ((m->flush_policy == FLUSH_LINE) && (b == '\n')) {
+        fflush(stdout);
+    }
+}
+
+/* A complete character from the KIM-1, for the paper tape being written
+ * or else the host's serial sink */
+void serial_out_char(KIM1Machine *m, uint8_t b) {
+    m->serial_bytes_out++;
+    if (m->writing_paper_tape) {
+        if (b != 0) {
+            fwrite(&b, 1, 1, m->paper_tape_file);
+        }
+    } else if (m->serial_out) {
+        m->serial_out(m, b);
+    }
+}
+
+int serial_in_queue_ready(KIM1Machine *m) {
+    return m->serial_in_queue_start != m->serial_in_queue_end;
+}
+
+int serial_in_queue_full(KIM1Machine *m) {
+    return (m->serial_in_queue_end + 1) % SERIAL_IN_QUEUE_SIZE == m->serial_in_queue_start;
+}
+
+void serial_in_queue_put(KIM1Machine *m, uint8_t b) {
+    m->serial_in_queue[m->serial_in_queue_end] = b;
+    m->serial_in_queue_end = (m->serial_in_queue_end + 1) % SERIAL_IN_QUEUE_SIZE;
+}
+
+uint8_t serial_in_queue_get(KIM1Machine *m) {
+    uint8_t b;
+    if (m->serial_in_queue_start == m->serial_in_queue_end) return 0;
+    b = m->serial_in_queue[m->serial_in_queue_start];
+    m->serial_in_queue_start = (m->serial_in_queue_start + 1) % SERIAL_IN_QUEUE_SIZE;
+    m->serial_bytes_in++;
+    return b;
+}
+
+/* Called by fake6502 after every instruction, to run the traps
+ * registered at the pc. Everything else that happens between instructions is an
+ * event on the machine's schedule. */
+void kim1_instruction_hook(CPU6502 *c) {
+    KIM1Machine *m = (KIM1Machine *) c;
+
+    // Trace the instruction that just finished, before any trap at the
+    // new pc changes the registers
+    if (m->trace) {
+        TRACE *t = m->trace;
+        TRACE_RECORD *r = &t->records[t->count & t->mask];
+        status6502(c);
+        r->cycle = kim1_cycles(m);
+        r->pc = t->pc;
+        r->ea = c->ea;
+        r->opcode = c->opcode;
+        r->op1 = kim1_peek(m, t->pc + 1);
+        r->op2 = kim1_peek(m, t->pc + 2);
+        r->a = c->a;
+        r->x = c->x;
+        r->y = c->y;
+        r->sp = c->sp;
+        r->status = c->status;
+        if (!(++t->count & t->mask) && t->file) {
+            trace_flush(m);
+        }
+    }
+
+    // Run any traps at the new pc. They can look at and change all of
+    // the registers, so the core's flags have to be up to date.
+    if (m->trap_map[c->pc >> 3] & (1 << (c->pc & 7))) {
+        status6502(c);
+        check_pc(m);
+    }
+
+    // Charge the instruction that just finished to the address it started
+    // at. Traps may have moved the pc, so the next one starts from here.
+    if (m->profile) {
+        PROFILE *p = m->profile;
+        p->count[p->pc]++;
+        p->cycles[p->pc] += c->clockticks6502 - p->ticks;
+        p->ticks = c->clockticks6502;
+        p->pc = c->pc;
+    }
+
+    if (m->trace) {
+        m->trace->pc = c->pc;
+    }
+}
+
+/* The event schedule is a small binary min-heap ordered by the cycle each
+ * event is due on. Each handler is on the schedule at most once, so
+ * scheduling a handler again just moves it. */
+void event_swap(KIM1Machine *m, int i, int j) {
+    EVENT tmp = m->events[i];
+    m->events[i] = m->events[j];
+    m->events[j] = tmp;
+}
+
+void event_sift(KIM1Machine *m, int i) {
+    int smallest, child;
+
+    while ((i > 0) && (m->events[i].when < m->events[(i-1)/2].when)) {
+        event_swap(m, i, (i-1)/2);
+        i = (i-1)/2;
+    }
+    for (;;) {
+        smallest = i;
+        for (child = 2*i+1; (child <= 2*i+2) && (child < m->num_events); child++) {
+            if (m->events[child].when < m->events[smallest].when) {
+                smallest = child;
+            }
+        }
+        if (smallest == i) break;
+        event_swap(m, i, smallest);
+        i = smallest;
+    }
+}
+
+void event_remove(KIM1Machine *m, int i) {
+    m->num_events--;
+    if (i < m->num_events) {
+        m->events[i] = m->events[m->num_events];
+        event_sift(m, i);
+    }
+}
+
+/* Schedule handler to be called once the machine reaches the given cycle.
+ * If this is earlier than the end of the burst the CPU is running, the
+ * burst is cut short so the event fires on time. */
+void kim1_schedule(KIM1Machine *m, uint64_t when, EVENT_HANDLER handler) {
+    int i;
+
+    for (i=0; i < m->num_events; i++) {
+        if (m->events[i].handler == handler) break;
+    }
+    if (i == m->num_events) {
+        if (m->num_events == MAX_EVENTS) {
+            fprintf(stderr, "Too many events scheduled\n");
+            return;
+        }
+        m->num_events++;
+    }
+    m->events[i].when = when;
+    m->events[i].handler = handler;
+    event_sift(m, i);
+
+    if (when < m->burst_end) {
+        m->burst_end = when;
+        m->cpu.clockgoal6502 = m->ticks_base + (uint32_t) (when - m->cycles_base);
+    }
+}
+
+void kim1_cancel(KIM1Machine *m, EVENT_HANDLER handler) {
+    for (int i=0; i < m->num_events; i++) {
+        if (m->events[i].handler == handler) {
+            event_remove(m, i);
+            return;
+        }
+    }
+}
+
+/* Run the machine for at least the given number of cycles. The CPU runs
+ * uninterrupted up to the next event on the schedule, then the events that
+ * are due are fired, and so on until the cycles are used up or something
+ * calls kim1_stop. */
+void kim1_run(KIM1Machine *m, uint32_t cycles) {
+    uint64_t now = kim1_cycles(m);
+    uint64_t end = now + cycles;
+    EVENT_HANDLER handler;
+
+    while ((now < end) && !m->stopped) {
+        m->burst_end = end;
+        if ((m->num_events > 0) && (m->events[0].when < m->burst_end)) {
+            m->burst_end = m->events[0].when;
+        }
+        // A trap that parked the CPU gets another look at the input first
+        if (m->idle_trap) {
+            handler = m->idle_trap;
+            m->idle_trap = NULL;
+            if (m->cpu.pc == m->idle_pc) {
+                handler(m);
+            }
+        }
+        if (m->burst_end > now) {
+            // Run up to the end of the burst, exactly, by setting the goal
+            // relative to the core's current one
+            exec6502(&m->cpu, m->ticks_base + (uint32_t) (m->burst_end - m->cycles_base) - m->cpu.clockgoal6502);
+
+            // Fold the 32-bit CPU tick counter into the 64-bit cycle count
+            m->cycles_run += (uint32_t) (m->cpu.clockticks6502 - m->ticks_base);
+            m->instructions_run += (uint32_t) (m->cpu.instructions - m->instructions_base);
+            m->cycles_base = kim1_cycles(m);
+            m->ticks_base = m->cpu.clockticks6502;
+            m->instructions_base = m->cpu.instructions;
+            now = m->cycles_base;
+        }
+        m->burst_end = 0;
+
+        while ((m->num_events > 0) && (m->events[0].when <= now)) {
+            handler = m->events[0].handler;
+            event_remove(m, 0);
+            handler(m);
+        }
+    }
+}
+
+/* Make kim1_run return once the current instruction and any events due
+ * have run. Safe to call from traps, events and the serial sink. */
+void kim1_stop(KIM1Machine *m) {
+    m->stopped = 1;
+    if (m->burst_end) {
+        m->burst_end = kim1_cycles(m);
+        m->cpu.clockgoal6502 = m->cpu.clockticks6502;
+    }
+}
+
+/* Called by a trap at the top of one of the ROM's input wait loops when
+ * there is nothing for it to read. Each time round the loop would look
+ * exactly the same, so rather than run it the CPU stays at the trap and
+ * the clock jumps to the end of the burst. kim1_run runs the trap again
+ * before the next burst, once the events have had a chance to deliver
+ * some input. */
+void kim1_idle(KIM1Machine *m, TRAP_HANDLER trap) {
+    uint64_t now = kim1_cycles(m);
+    uint32_t skip;
+
+    if (!m->idle_detect || (m->burst_end <= now)) {
+        return;
+    }
+    skip = m->burst_end - now;
+    m->cpu.clockticks6502 += skip;
+    m->idle_cycles += skip;
+    m->idle_trap = trap;
+    m->idle_pc = m->cpu.pc;
+    // Time spent idle isn't charged to the instruction before it
+    if (m->profile) {
+        m->profile->ticks += skip;
+    }
+}
+
+/* The cycle the next event is due on, for a host that wants to sleep
+ * until then */
+uint64_t kim1_next_event(KIM1Machine *m) {
+    return m->num_events > 0 ? m->events[0].when : UINT64_MAX;
+}
+
+/* While single step is on, an NMI is raised after every instruction that
+ * started below the ROM, so this event re-arms itself one cycle ahead,
+ * which is the end of the next instruction. */
+void single_step_event(KIM1Machine *m) {
+    if (m->enable_SST_NMI) {
+        nmi6502(&m->cpu);
+    }
+
+    // This seems like a hack but it's basically how the hardware does it
+    m->enable_SST_NMI = (m->cpu.pc < 0x1c00);
+    kim1_schedule(m, kim1_cycles(m) + 1, single_step_event);
+}
+
+void kim1_set_single_step(KIM1Machine *m, int on) {
+    m->single_step = on;
+    if (on) {
+        m->enable_SST_NMI = (m->cpu.pc < 0x1c00);
+        kim1_schedule(m, kim1_cycles(m) + 1, single_step_event);
+    } else {
+        kim1_cancel(m, single_step_event);
+    }
+}
+
+/* Total cycles the machine has run. The CPU's own counter is only 32 bits,
+ * so this adds the ticks since the end of the last kim1_run to a 64-bit
+ * base. */
+uint64_t kim1_cycles(KIM1Machine *m) {
+    return m->cycles_base + (uint32_t) (m->cpu.clockticks6502 - m->ticks_base);
+}
+
+long current_time_millis() {
+    struct timespec tv;
+    clock_gettime(CLOCK_REALTIME, &tv);
+    return tv.tv_sec * 1000 + tv.tv_nsec / 1000000;
+}
+
+/* Register a handler to be called whenever the CPU reaches addr. The trap
+ * bitmap makes the check after each instruction a single load, so traps
+ * cost nothing at addresses that don't have one. */
+int kim1_add_trap(KIM1Machine *m, uint16_t addr, TRAP_HANDLER handler) {
+    if (m->num_traps == MAX_TRAPS) {
+        fprintf(stderr, "Too many traps registered\n");
+        return -1;
+    }
+    m->traps[m->num_traps].addr = addr;
+    m->traps[m->num_traps].handler = handler;
+    m->num_traps++;
+    m->trap_map[addr >> 3] |= 1 << (addr & 7);
+    return 0;
+}
+
+void kim1_remove_trap(KIM1Machine *m, uint16_t addr, TRAP_HANDLER handler) {
+    int i, still_trapped = 0;
+
+    for (i=0; i < m->num_traps; i++) {
+        if ((m->traps[i].addr == addr) && (m->traps[i].handler == handler)) {
+            m->num_traps--;
+            memmove(&m->traps[i], &m->traps[i+1], (m->num_traps - i) * sizeof(TRAP));
+            break;
+        }
+    }
+    for (i=0; i < m->num_traps; i++) {
+        if (m->traps[i].addr == addr) still_trapped = 1;
+    }
+    if (!still_trapped) {
+        m->trap_map[addr >> 3] &= ~(1 << (addr & 7));
+    }
+}
+
+/* Run the handlers registered at the current pc, in the order they were
+ * added. A handler that moves the pc ends the run, the remaining
+ * handlers were meant for an instruction that is no longer next. */
+void check_pc(KIM1Machine *m) {
+    uint16_t pc = m->cpu.pc;
+
+    m->trap_hits++;
+    for (int i=0; i < m->num_traps; i++) {
+        if (m->traps[i].addr == pc) {
+            m->traps[i].handler(m);
+            if (m->cpu.pc != pc) return;
+        }
+    }
+}
+
+/* Breakpoints are traps that stop the machine before the instruction at
+ * their address runs */
+int kim1_add_breakpoint(KIM1Machine *m, uint16_t addr) {
+    if (kim1_is_breakpoint(m, addr)) {
+        return 0;
+    }
+    return kim1_add_trap(m, addr, breakpoint_trap);
+}
+
+void kim1_remove_breakpoint(KIM1Machine *m, uint16_t addr) {
+    kim1_remove_trap(m, addr, breakpoint_trap);
+}
+
+int kim1_is_breakpoint(KIM1Machine *m, uint16_t addr) {
+    for (int i=0; i < m->num_traps; i++) {
+        if ((m->traps[i].addr == addr) && (m->traps[i].handler == breakpoint_trap)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void breakpoint_trap(KIM1Machine *m) {
+    m->debug_hit = DEBUG_BREAK;
+    m->debug_addr = m->cpu.pc;
+    kim1_stop(m);
+}
+
+/* Watch reads and/or writes to lo-hi inclusive. Returns -1 if there are
+ * too many watches already. */
+int kim1_add_watch(KIM1Machine *m, uint16_t lo, uint16_t hi, uint8_t flags) {
+    if (m->num_watches == MAX_WATCHES) {
+        return -1;
+    }
+    m->watches[m->num_watches].lo = lo;
+    m->watches[m->num_watches].hi = hi;
+    m->watches[m->num_watches].flags = flags;
+    m->num_watches++;
+    kim1_apply_watches(m);
+    return 0;
+}
+
+/* Remove the watches that overlap lo-hi */
+void kim1_remove_watch(KIM1Machine *m, uint16_t lo, uint16_t hi) {
+    int n = 0;
+
+    for (int i=0; i < m->num_watches; i++) {
+        if ((m->watches[i].hi < lo) || (m->watches[i].lo > hi)) {
+            m->watches[n++] = m->watches[i];
+        }
+    }
+    m->num_watches = n;
+    kim1_apply_watches(m);
+}
+
+/* Rebuild the watch bitmaps from the list of watches, and take the pages
+ * they are on out of the memory map */
+void kim1_apply_watches(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+
+    // Put back the pages the last set of watches took out
+    for (int page=0; page < 256; page++) {
+        if (m->watch_pages[page] & WATCH_READ) {
+            c->readmap[page] = m->watch_readmap[page];
+        }
+        if (m->watch_pages[page] & WATCH_WRITE) {
+            c->writemap[page] = m->watch_writemap[page];
+        }
+    }
+    memset(m->watch_pages, 0, sizeof(m->watch_pages));
+    memset(m->watch_read_map, 0, sizeof(m->watch_read_map));
+    memset(m->watch_write_map, 0, sizeof(m->watch_write_map));
+
+    for (int i=0; i < m->num_watches; i++) {
+        WATCH *w = &m->watches[i];
+        for (uint32_t addr = w->lo; addr <= w->hi; addr++) {
+            if (w->flags & WATCH_READ) {
+                m->watch_read_map[addr >> 3] |= 1 << (addr & 7);
+            }
+            if (w->flags & WATCH_WRITE) {
+                m->watch_write_map[addr >> 3] |= 1 << (addr & 7);
+            }
+            m->watch_pages[addr >> 8] |= w->flags;
+        }
+    }
+
+    for (int page=0; page < 256; page++) {
+        if (m->watch_pages[page] & WATCH_READ) {
+            m->watch_readmap[page] = c->readmap[page];
+            c->readmap[page] = NULL;
+        }
+        if (m->watch_pages[page] & WATCH_WRITE) {
+            m->watch_writemap[page] = c->writemap[page];
+            c->writemap[page] = NULL;
+        }
+    }
+}
+
+/* The display trap is a hack to make the simulator a little smoother.
+ * It traps the call to display digits, but only late into the
+ * processing so programs like Wumpus that display non-standard
+ * values can still work. */
+void display_trap(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+
+    display_digit(m, c->x, c->a);
+    c->pc = 0x1f5e;
+}
+
+/* Light the digit the ROM selects with X with the given segments */
+void display_digit(KIM1Machine *m, uint8_t x, uint8_t segments) {
+    int digit = 9 - (x >> 1);
+
+    if (m->display[digit] != segments) {
+        if (!m->display_changed) {
+            m->display_changed_time = current_time_millis();
+        }
+        m->display_changed = 1;
+        m->display[digit] = segments;
+    }
+}
+
+/* If we get to the place where a character has been read,
+ * clear out the pending keyboard character. */
+void key_read_trap(KIM1Machine *m) {
+    m->char_pending = 0x15;
+}
+
+/* After a reset the ROM times the start bit of the first character typed
+ * to work out the baud rate, but the serial line here never has bits on
+ * it, so in serial mode skip straight to START. The bit timing is only
+ * used by the ROM's own bit-banging, which the emulator doesn't time. */
+void detcps_trap(KIM1Machine *m) {
+    if (m->kim1_serial_mode) {
+        m->cpu.pc = 0x1c4f;
+    }
+}
+
+/* The monitor's keypad loop, waiting for a key to be pressed */
+void key_wait_trap(KIM1Machine *m) {
+    if ((m->char_pending == 0x15) && !m->kim1_serial_mode) {
+        kim1_idle(m, key_wait_trap);
+    }
+}
+
+/* GETCH, feed the serial port from the input queue or the paper tape.
+ * With neither, the ROM would read a NUL off the idle line and come
+ * straight back, so the machine can idle here instead. */
+void getch_trap(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    int tap_ch;
+
+    if (serial_in_queue_ready(m)) {
+        c->pc = 0x1e85;
+        c->a = serial_in_queue_get(m);
+        c->y = 0xff;
+    } else if (m->reading_paper_tape) {
+        if ((tap_ch = fgetc(m->paper_tape_file)) != EOF) {
+            m->serial_bytes_in++;
+            c->pc = 0x1e85;
+            c->a = (uint8_t) tap_ch;
+            c->y = 0xff;
+        } else {
+            fclose(m->paper_tape_file);
+            m->reading_paper_tape = 0;
+            printf("Tape loaded.\n");
+        }
+    } else {
+        kim1_idle(m, getch_trap);
+    }
+}
+
+/* The ROM's load is about to start. Once the host has opened a tape, it
+ * is loaded natively and the CPU is sent to the end of the ROM's LOAD
+ * routine, which prints KIM (or ERR) and returns to the monitor. A tape
+ * that doesn't parse is left for the ROM to read a character at a time. */
+void tape_load_trap(KIM1Machine *m) {
+    int status;
+
+    if (!m->auto_tape || !m->tape_prompt) {
+        return;
+    }
+    m->tape_prompt(m, 0);
+    if (!m->reading_paper_tape) {
+        return;
+    }
+
+    // Whatever follows the last record is still fed through GETCH, just
+    // as the ROM would have read it
+    status = kim1_load_tape(m, m->paper_tape_file);
+    if (status == TAPE_OK) {
+        m->cpu.pc = 0x1d2e;
+    } else if (status == TAPE_CHECKSUM) {
+        m->cpu.pc = 0x1d3e;
+    } else {
+        // Leave anything we can't parse to the ROM's own loader
+        fseek(m->paper_tape_file, 0, SEEK_SET);
+    }
+}
+
+int tape_hex(uint8_t *buf, long len, long *pos, uint8_t *b) {
+    int v = 0, d;
+
+    for (int i=0; i < 2; i++) {
+        if (*pos >= len) return -1;
+        d = buf[(*pos)++];
+        if ((d >= '0') && (d <= '9')) {
+            d -= '0';
+        } else if ((d >= 'A') && (d <= 'F')) {
+            d -= 'A' - 10;
+        } else if ((d >= 'a') && (d <= 'f')) {
+            d -= 'a' - 10;
+        } else {
+            return -1;
+        }
+        v = (v << 4) | d;
+    }
+    *b = v;
+    return 0;
+}
+
+/* Load a paper tape in the KIM-1 format straight into memory. Each record
+ * is ;LLAAAA, LL data bytes and a 16-bit checksum of everything after the
+ * semicolon, all in hex. The last record has a length of 00 and the record
+ * count in place of the address.
+ *
+ * The zero page is left exactly as the ROM's LOAD routine would leave it:
+ * POINTL/POINTH (fa/fb) past the last byte stored, or holding the record
+ * count after the last record, CHKSUM (f6/f7) and INL/INH (f8/f9) holding
+ * the last checksum read. Like the ROM, a record is stored before its
+ * checksum is checked and loading stops at the first bad record. The
+ * file is left positioned just past the last character used. */
+int kim1_load_tape(KIM1Machine *m, FILE *in) {
+    uint8_t *buf, count, hi, lo, b;
+    uint16_t addr, sum;
+    long len, pos = 0;
+    int i, status = TAPE_BAD;
+
+    fseek(in, 0, SEEK_END);
+    len = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    if ((len <= 0) || ((buf = malloc(len)) == NULL)) {
+        return TAPE_BAD;
+    }
+    len = fread(buf, 1, len, in);
+
+    for (;;) {
+        while ((pos < len) && (buf[pos] != ';')) pos++;
+        if (pos++ >= len) break;
+
+        if (tape_hex(buf, len, &pos, &count) || tape_hex(buf, len, &pos, &hi) ||
+                tape_hex(buf, len, &pos, &lo)) break;
+        sum = count + hi + lo;
+        addr = (hi << 8) | lo;
+
+        for (i=0; i < count; i++) {
+            if (tape_hex(buf, len, &pos, &b)) break;
+            write6502(&m->cpu, addr++, b);
+            sum += b;
+        }
+        if ((i < count) || tape_hex(buf, len, &pos, &hi) || tape_hex(buf, len, &pos, &lo)) break;
+
+        kim1_poke(m, 0xf6, sum >> 8);
+        kim1_poke(m, 0xf7, sum & 0xff);
+        kim1_poke(m, 0xf8, lo);
+        kim1_poke(m, 0xf9, hi);
+        kim1_poke(m, 0xfa, addr & 0xff);
+        kim1_poke(m, 0xfb, addr >> 8);
+        m->cpu.x = (count == 0) ? 0 : 1;
+
+        if (((hi << 8) | lo) != sum) {
+            status = TAPE_CHECKSUM;
+            break;
+        }
+        if (count == 0) {
+            status = TAPE_OK;
+            break;
+        }
+    }
+    fseek(in, pos, SEEK_SET);
+    free(buf);
+    return status;
+}
+
+/* Return from a trapped subroutine as RTS would */
+void trap_rts(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+    uint16_t addr;
+
+    addr = read6502(c, 0x100 + (uint8_t) (c->sp + 1));
+    addr |= read6502(c, 0x100 + (uint8_t) (c->sp + 2)) << 8;
+    c->sp += 2;
+    c->pc = addr + 1;
+}
+
+/* OUTCH sends the character in A by toggling the serial line bit by bit,
+ * with a delay loop between bits. In fast TTY mode the character goes
+ * straight to the sink, the registers and zero page are left as OUTCH
+ * would leave them, and the CPU returns to the caller. */
+void outch_trap(KIM1Machine *m) {
+    if (!m->fast_tty) {
+        return;
+    }
+    outch(m);
+    trap_rts(m);
+}
+
+/* Everything OUTCH does to send A, short of returning */
+void outch(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+
+    serial_out_char(m, c->a);
+
+    // CHAR has been shifted out, TMPX holds X, the line is left at the
+    // stop bit and the bit delay leaves TIMH, A and Y at ff
+    kim1_poke(m, 0xfe, 0);
+    kim1_poke(m, 0xfd, c->x);
+    m->riot002.sbd |= 1;
+    write6502(c, 0x17f4, 0xff);
+    c->a = 0xff;
+    c->y = 0xff;
+    c->status &= ~(FLAG_CARRY | FLAG_ZERO | FLAG_SIGN);
+    if (c->x == 0) c->status |= FLAG_ZERO;
+    if (c->x & 0x80) c->status |= FLAG_SIGN;
+}
+
+void tape_dump_trap(KIM1Machine *m) {
+    if (m->tape_prompt) {
+        m->tape_prompt(m, 1);
+    }
+}
+
+void tape_saved_trap(KIM1Machine *m) {
+    if (m->writing_paper_tape) {
+        printf("Tape saved.\n");
+        fclose(m->paper_tape_file);
+        m->writing_paper_tape = 0;
+    }
+}
+
+/* Build the page table for the memory map. Plain RAM and ROM pages point
+ * straight at their bytes so the CPU core never calls back for them. Only
+ * the 0x17xx page, where the RIOT I/O registers and RAM live, and writes
+ * to ROM or unmapped pages go through read6502/write6502.
+ *
+ *   0000 - max_ram   RAM (up to 5K below the ROM, or everything for "full")
+ *   1700 - 17ff      RIOT I/O and RAM, handled by io_read/io_write
+ *   1800 - 1bff      6530-003 ROM
+ *   1c00 - 1fff      6530-002 ROM
+ *   9c00 - 9fff      6530-002 ROM mirror (what the reset vector lands in)
+ *   ff00 - ffff      6530-002 ROM mirror of 1f00-1fff, holds the vectors
+ *
+ * Anything else reads as 0 and ignores writes. */
+void build_memory_map(KIM1Machine *m) {
+    static uint8_t unmapped_page[256];
+    CPU6502 *c = &m->cpu;
+
+    for (int page=0; page < 256; page++) {
+        if (page * 256 < m->max_ram) {
+            c->readmap[page] = &m->ram[page * 256];
+            c->writemap[page] = &m->ram[page * 256];
+        } else {
+            c->readmap[page] = unmapped_page;
+            c->writemap[page] = NULL;
+        }
+    }
+    for (int page=0x18; page < 0x1c; page++) {
+        c->readmap[page] = &m->riot003.rom[(page - 0x18) * 256];
+        c->writemap[page] = NULL;
+    }
+    for (int page=0x1c; page < 0x20; page++) {
+        c->readmap[page] = &m->riot002.rom[(page - 0x1c) * 256];
+        c->writemap[page] = NULL;
+        c->readmap[page + 0x80] = &m->riot002.rom[(page - 0x1c) * 256];
+        c->writemap[page + 0x80] = NULL;
+    }
+    c->readmap[0xff] = &m->riot002.rom[0x300];
+    c->writemap[0xff] = NULL;
+
+    c->readmap[0x17] = NULL;
+    c->writemap[0x17] = NULL;
+
+    memset(m->watched_pages, 0, sizeof(m->watched_pages));
+
+    // The pages are all freshly mapped, take the watched ones out again
+    memset(m->watch_pages, 0, sizeof(m->watch_pages));
+    kim1_apply_watches(m);
+}
+
+/* Take every RAM page out of the write map, so the next write to each one
+ * goes through write6502 and calls page_written once before the page is
+ * mapped back in. Pages that aren't written cost nothing. */
+void kim1_watch_ram_writes(KIM1Machine *m) {
+    CPU6502 *c = &m->cpu;
+
+    for (int page=0; page < 256; page++) {
+        uint8_t **map = (m->watch_pages[page] & WATCH_WRITE) ? &m->watch_writemap[page] : &c->writemap[page];
+        if ((*map == &m->ram[page * 256]) && (page * 256 < m->max_ram)) {
+            *map = NULL;
+            m->watched_pages[page] = 1;
+        }
+    }
+}
+
+void ram_page_written(KIM1Machine *m, int page) {
+    m->watched_pages[page] = 0;
+    if (m->watch_pages[page] & WATCH_WRITE) {
+        m->watch_writemap[page] = &m->ram[page * 256];
+    } else {
+        m->cpu.writemap[page] = &m->ram[page * 256];
+    }
+    if (m->page_written) {
+        m->page_written(m, page);
+    }
+}
+
+/* Change the amount of RAM and rebuild the memory map to match */
+void kim1_set_ram(KIM1Machine *m, int max_ram) {
+    m->max_ram = max_ram;
+    build_memory_map(m);
+}
+
+/* Handle reads from the 0x17xx page, the RIOT I/O registers and RAM */
+uint8_t io_read(KIM1Machine *m, uint16_t address) {
+    if (address >= 0x17c0) {
+        return m->riot002.ram[address - 0x17c0];
+    } else if (address >= 0x1780) {
+        return m->riot003.ram[address - 0x1780];
+    } else if (address >= 0x1740) {
+        return riot002read(m, address);
+    } else {
+        return riot003read(m, address);
+    }
+}
+
+void io_write(KIM1Machine *m, uint16_t address, uint8_t value) {
+    if (address >= 0x17c0) {
+        m->riot002.ram[address - 0x17c0] = value;
+    } else if (address >= 0x1780) {
+        m->riot003.ram[address - 0x1780] = value;
+    } else if (address >= 0x1740) {
+        riot002write(m, address, value);
+    } else {
+        riot003write(m, address, value);
+    }
+}
+
+/* Callback from the fake6502 library, handle reads from RAM or the RIOT chips */
+uint8_t read6502(CPU6502 *c, uint16_t address) {
+    KIM1Machine *m = (KIM1Machine *) c;
+    uint8_t *page = c->readmap[address >> 8];
+    uint8_t value;
+
+    if (page) {
+        return page[address & 0xff];
+    }
+    if (m->watch_pages[address >> 8] & WATCH_READ) {
+        page = m->watch_readmap[address >> 8];
+        value = page ? page[address & 0xff] : io_read(m, address);
+        if (m->watch_read_map[address >> 3] & (1 << (address & 7))) {
+            m->debug_hit = DEBUG_READ;
+            m->debug_addr = address;
+            m->debug_value = value;
+            kim1_stop(m);
+        }
+        return value;
+    }
+    return io_read(m, address);
+}
+
+/* Callback from the fake6502 library, handle writes to RAM or the RIOT chips */
+void write6502(CPU6502 *c, uint16_t address, uint8_t value) {
+    KIM1Machine *m = (KIM1Machine *) c;
+    uint8_t *page = c->writemap[address >> 8];
+
+    if (page) {
+        page[address & 0xff] = value;
+        return;
+    }
+    if (m->watch_pages[address >> 8] & WATCH_WRITE) {
+        if (m->watch_write_map[address >> 3] & (1 << (address & 7))) {
+            m->debug_hit = DEBUG_WRITE;
+            m->debug_addr = address;
+            m->debug_value = value;
+            kim1_stop(m);
+        }
+        if ((page = m->watch_writemap[address >> 8]) != NULL) {
+            page[address & 0xff] = value;
+            return;
+        }
+    }
+    if ((address >> 8) == 0x17) {
+        io_write(m, address, value);
+    } else if (m->watched_pages[address >> 8]) {
+        ram_page_written(m, address >> 8);
+        m->ram[address] = value;
+    } else if (m->report_stray_writes) {
+        fprintf(stderr, "Write %02x to %04x\n", value, address);
+    }
+}
+
+/* Handle reads from the 003 RIOT chip, which mostly do nothing */
+uint8_t riot003read(KIM1Machine *m, uint16_t address) {
+    uint64_t now;
+    if (address == 0x1700) {
+        return m->riot003.sad;
+    } else if (address == 0x1701) {
+        return m->riot003.padd;
+    } else if (address == 0x1702) {
+        return m->riot003.sad;
+    } else if (address == 0x1703) {
+        return m->riot003.pbdd;
+    } else if ((address == 0x1706) || (address == 0x170e)) {
+        if (m->fast_timers) {
+            timer_fast_forward(m, &m->riot003.timer, address);
+        }
+        now = kim1_cycles(m);
+        if (timer_timeout(&m->riot003.timer, now)) {
+            reset_timer(&m->riot003.timer, m->riot003.timer.timer_mult, m->riot003.timer.start_value, now);
+            return 0;
+        } else {
+            return timer_count(&m->riot003.timer, now);
+        }
+    } else if (address == 0x1707) {
+        if (m->fast_timers) {
+            timer_fast_forward(m, &m->riot003.timer, address);
+        }
+        if (timer_timeout(&m->riot003.timer, kim1_cycles(m))) {
+            return 0x80;
+        } else {
+            return 0;
+        }
+    }
+}
+
+// key_bits holds the bit patterns for a key depressed on
+// each keyboard row (3 rows, 7 keys).
+uint8_t key_bits[7] = { 0xbf, 0xdf, 0xef, 0xf7, 0xfb, 0xfd, 0xfe };
+
+uint8_t riot002read(KIM1Machine *m, uint16_t address) {
+    uint8_t sv, nextval;
+    uint64_t now;
+    if (address == 0x1740) {
+        sv = (m->riot002.sbd >> 1) & 0xf;
+        // Return the correct key_bits if the current key depressed
+        // belongs to the right scan row, otherwise 0xff, meaning
+        // nothing on that row is depressed.
+        if (sv == 0) {
+            if (m->char_pending <= 6) {
+                return key_bits[m->char_pending];
+            } else {
+                return 0xff;
+            }
+        } else if (sv == 1) {
+            if ((m->char_pending >= 7) && (m->char_pending <= 13)) {
+                return key_bits[m->char_pending-7];
+            } else {
+                return 0xff;
+            }
+        } else if (sv == 2) {
+            if ((m->char_pending >= 14) && (m->char_pending <= 20)) {
+                return key_bits[m->char_pending-14];
+            } else {
+                return 0xff;
+            }
+        } else if (sv == 3) {
+            if (m->kim1_serial_mode) {
+                return 0;
+            }
+            return 0xff;
+        } else {
+            return 0x80;
+        }
+    } else if (address == 0x1741) {
+        return m->riot002.padd;
+    } else if (address == 0x1742) {
+        if (m->sending_serial) {
+            m->serial_out_bit_ready = 1;
+        }
+        return m->riot002.sbd;
+    } else if (address == 0x1743) {
+        return m->riot002.pbdd;
+    } else if ((address == 0x1746) || (address == 0x174e)) {
+        if (m->fast_timers) {
+            timer_fast_forward(m, &m->riot002.timer, address);
+        }
+        now = kim1_cycles(m);
+        if (timer_timeout(&m->riot002.timer, now)) {
+            reset_timer(&m->riot002.timer, m->riot002.timer.timer_mult, m->riot002.timer.start_value, now);
+            return 0;
+        } else {
+            return timer_count(&m->riot002.timer, now);
+        }
+    } else if (address == 0x1747) {
+        if (m->fast_timers) {
+            timer_fast_forward(m, &m->riot002.timer, address);
+        }
+        if (timer_timeout(&m->riot002.timer, kim1_cycles(m))) {
+            return 0x80;
+        } else {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+void riot003write(KIM1Machine *m, uint16_t address, uint8_t value) {
+    switch (address) {
+        case 0x1700:
+            m->riot003.sad = value;
+            break;
+        
+        case 0x1701:
+            m->riot003.padd = value;
+            break;
+
+        case 0x1702:
+            m->riot003.sbd = value;
+            break;
+
+        case 0x1703:
+            m->riot003.pbdd = value;
+            break;
+
+        case 0x1704:
+            reset_timer(&m->riot003.timer, 1, value, kim1_cycles(m));
+            break;
+
+        case 0x1705:
+            reset_timer(&m->riot003.timer, 8, value, kim1_cycles(m));
+            break;
+
+        case 0x1706:
+            reset_timer(&m->riot003.timer, 64, value, kim1_cycles(m));
+            break;
+
+        case 0x1707:
+            reset_timer(&m->riot003.timer, 1024, value, kim1_cycles(m));
+            break;
+    }
+}
+
+void riot002write(KIM1Machine *m, uint16_t address, uint8_t value) {
+    switch (address) {
+        case 0x1740:
+            m->riot002.sad = value;
+            break;
+        
+        case 0x1741:
+            m->riot002.padd = value;
+            break;
+
+        case 0x1742:
+            m->riot002.sbd = value;
+            if (!m->sending_serial && ((value & 1) == 0)) {
+                m->sending_serial = 1;
+                m->serial_out_count = 0;
+                m->serial_out_byte = 0;
+                m->serial_out_bit_ready = 0;
+            } else if (m->sending_serial && m->serial_out_bit_ready) {
+                if (m->serial_out_count == 8) {
+                    serial_out_char(m, m->serial_out_byte);
+                    m->sending_serial = 0;
+                }
+                m->serial_out_byte = ((m->serial_out_byte >> 1) & 0x7f) | ((value & 1) << 7);
+                m->serial_out_count++;
+                m->serial_out_bit_ready = 0;
+            }
+            break;
+
+        case 0x1743:
+            m->riot002.pbdd = value;
+            break;
+
+        case 0x1744:
+            reset_timer(&m->riot002.timer, 1, value, kim1_cycles(m));
+            break;
+
+        case 0x1745:
+            reset_timer(&m->riot002.timer, 8, value, kim1_cycles(m));
+            break;
+
+        case 0x1746:
+            reset_timer(&m->riot002.timer, 64, value, kim1_cycles(m));
+            break;
+
+        case 0x1747:
+            reset_timer(&m->riot002.timer, 1024, value, kim1_cycles(m));
+            break;
+    }
+}
+
+/* The 6530 timers cost nothing while they run. Writing a timer just records
+ * the cycle it was started on, and the count and timeout flag are worked out
+ * from the machine's cycle counter only when the program reads them. Since
+ * the cycle counter is paced against the host clock, this is accurate at
+ * 1 MHz and keeps the same timing, in cycles, at any -speed.
+ *
+ * The divide rates are all powers of two, so timer_shift holds log2 of
+ * timer_mult. */
+void reset_timer(TIMER *timer, int scale, uint8_t start_value, uint64_t now) {
+    timer->timer_mult = scale;
+    timer->timer_shift = 0;
+    while ((1 << timer->timer_shift) < scale) {
+        timer->timer_shift++;
+    }
+    timer->start_value = start_value;
+    timer->start_cycle = now;
+}
+
+int timer_timeout(TIMER *timer, uint64_t now) {
+    if (timer->timer_mult == 0) {
+        return 0;
+    }
+    return ((now - timer->start_cycle) >> timer->timer_shift) >= timer->start_value;
+}
+
+uint8_t timer_count(TIMER *timer, uint64_t now) {
+    uint64_t elapsed;
+    if (timer->timer_mult == 0) {
+        return timer->start_value;
+    }
+    elapsed = (now - timer->start_cycle) >> timer->timer_shift;
+    if (elapsed >= timer->start_value) {
+        return 0;
+    }
+    return timer->start_value - elapsed;
+}
+
+// Which status flag each branch opcode tests, by its top two bits
+uint8_t branch_flags[4] = { FLAG_SIGN, FLAG_OVERFLOW, FLAG_CARRY, FLAG_ZERO };
+
+/* Called as the CPU reads a timer. If the read is the first half of a
+ * two instruction loop, a BIT, LDA, LDX or LDY of the timer followed by a
+ * branch back to it, every pass until the timer runs out (or its count
+ * changes enough to end the loop) reads the same value and changes
+ * nothing else. So rather than run them, the clock is moved on by whole
+ * passes to the last one that would run before the end of the burst or
+ * before the loop could end, and this read carries on from there as if
+ * they had all run. */
+void timer_fast_forward(KIM1Machine *m, TIMER *timer, uint16_t address) {
+    CPU6502 *c = &m->cpu;
+    uint16_t loop = c->pc - 3;
+    uint8_t branch = kim1_peek(m, c->pc);
+    uint16_t target = c->pc + 2 + (int8_t) kim1_peek(m, c->pc + 1);
+    uint64_t now = kim1_cycles(m);
+    uint64_t t, change;
+    uint32_t period, passes = 0, n;
+    uint8_t v, status, flag;
+
+    if (((c->opcode != 0x2c) && (c->opcode != 0xad) && (c->opcode != 0xae) && (c->opcode != 0xac)) ||
+            (c->ea != address) || ((branch & 0x1f) != 0x10) || (target != loop) ||
+            (timer->timer_mult == 0) || (m->burst_end <= now)) {
+        return;
+    }
+    // Traps, the trace and the profile all need to see every instruction
+    if (m->trace || m->profile ||
+            (m->trap_map[loop >> 3] & (1 << (loop & 7))) ||
+            (m->trap_map[c->pc >> 3] & (1 << (c->pc & 7)))) {
+        return;
+    }
+
+    // 4 cycles for the read and 3 for the branch taken, 4 if it crosses
+    // a page
+    period = ((c->pc + 2) & 0xff00) == (loop & 0xff00) ? 7 : 8;
+    flag = branch_flags[branch >> 6];
+
+    for (t = now;;) {
+        // A read that sees the timeout may reset the timer, leave it to
+        // happen for real
+        if (timer_timeout(timer, t)) {
+            break;
+        }
+        v = (address & 1) ? 0 : timer_count(timer, t);
+        // N and Z are worked out from v, so it doesn't matter if the core
+        // hasn't put its own in status yet
+        status = c->status;
+        if (c->opcode == 0x2c) {
+            status = (status & ~(FLAG_SIGN | FLAG_OVERFLOW | FLAG_ZERO)) | (v & 0xc0) | ((c->a & v) ? 0 : FLAG_ZERO);
+        } else {
+            status = (status & ~(FLAG_SIGN | FLAG_ZERO)) | (v & 0x80) | (v ? 0 : FLAG_ZERO);
+        }
+        if (((status & flag) != 0) != ((branch >> 5) & 1)) {
+            break;
+        }
+
+        // The value read stays the same until the timer next counts down
+        change = timer->start_cycle + ((((t - timer->start_cycle) >> timer->timer_shift) + 1) << timer->timer_shift);
+        n = (change - t + period - 1) / period;
+        if (t + (uint64_t) n * period >= m->burst_end) {
+            n = (m->burst_end - 1 - t) / period;
+            passes += n;
+            break;
+        }
+        t += (uint64_t) n * period;
+        passes += n;
+    }
+
+    c->clockticks6502 += passes * period;
+    c->instructions += 2 * passes;
+}
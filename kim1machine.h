@@ -0,0 +1,252 @@
+/* A complete KIM-1: the 6502, both 6530 RIOT chips, RAM, the LED display
+ * and the serial port. All of the state lives in a KIM1Machine, so a
+ * process can host as many machines as it likes. */
+#ifndef KIM1MACHINE_H
+#define KIM1MACHINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "fake6502.h"
+
+typedef struct TIMER {
+    uint16_t timer_mult;
+    uint8_t timer_shift;
+    uint8_t start_value;
+    uint64_t start_cycle;
+} TIMER;
+
+typedef struct RIOT {
+    uint8_t rom[1024];
+    uint8_t ram[64];
+    uint8_t padd, sad;
+    uint8_t pbdd, sbd;
+    TIMER timer;
+} RIOT;
+
+#define SERIAL_IN_QUEUE_SIZE 1024
+
+struct KIM1Machine;
+typedef void (*EVENT_HANDLER)(struct KIM1Machine *);
+
+typedef struct EVENT {
+    uint64_t when;              // machine cycle the event is due on
+    EVENT_HANDLER handler;
+} EVENT;
+
+#define MAX_EVENTS 16
+
+typedef void (*TRAP_HANDLER)(struct KIM1Machine *);
+
+typedef struct TRAP {
+    uint16_t addr;
+    TRAP_HANDLER handler;
+} TRAP;
+
+#define MAX_TRAPS 64
+
+// Watchpoint flags, for a watch and for each page in watch_pages
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+
+typedef struct WATCH {
+    uint16_t lo, hi;
+    uint8_t flags;
+} WATCH;
+
+#define MAX_WATCHES 16
+
+// What stopped the machine for the debugger
+#define DEBUG_NONE 0
+#define DEBUG_BREAK 1
+#define DEBUG_READ 2
+#define DEBUG_WRITE 3
+
+// When the serial sink flushes its output: at the end of every line, once
+// per front end poll, or only on exit
+#define FLUSH_LINE 0
+#define FLUSH_FRAME 1
+#define FLUSH_EXIT 2
+
+// Results from kim1_load_tape
+#define TAPE_OK 0
+#define TAPE_CHECKSUM 1
+#define TAPE_BAD 2
+
+typedef struct KIM1Machine {
+    // The CPU must be the first member, read6502 and write6502 get
+    // a CPU6502 pointer and cast it back to the machine.
+    CPU6502 cpu;
+
+    uint8_t ram[65536];
+    // Use kim1_set_ram to change this, the memory map is built from it
+    int max_ram;
+
+    RIOT riot003;
+    RIOT riot002;
+
+    uint8_t display[6];
+    uint8_t display_changed;
+    long display_changed_time;
+
+    uint8_t char_pending;
+    uint8_t single_step;
+    uint8_t enable_SST_NMI;
+
+    // 64-bit cycle count as of the end of the last kim1_run, and the
+    // value of the CPU's 32-bit clockticks6502 at that point
+    uint64_t cycles_base;
+    uint32_t ticks_base;
+
+    // Scheduled events, a min-heap on when, and the cycle the current
+    // burst of exec6502 runs to (0 outside of a burst)
+    EVENT events[MAX_EVENTS];
+    int num_events;
+    uint64_t burst_end;
+    // Set by kim1_stop to make kim1_run return early, the host clears it
+    uint8_t stopped;
+    // With idle_detect on, the ROM's input wait loops aren't run while
+    // there is no input for them. The clock jumps to the end of each burst
+    // instead, with the CPU parked at idle_pc until idle_trap lets it go.
+    uint8_t idle_detect;
+    // Skip the iterations of a loop that only polls a RIOT timer
+    uint8_t fast_timers;
+    uint16_t idle_pc;
+    void (*idle_trap)(struct KIM1Machine *);
+
+    // Running totals for the host's metrics. Unlike the cycle count these
+    // only ever go up, a rewind or snapshot load doesn't take them back.
+    uint64_t cycles_run;
+    uint64_t instructions_run;
+    uint32_t instructions_base;     // cpu.instructions at the last fold
+    uint64_t trap_hits;
+    uint64_t idle_cycles;
+    uint64_t serial_bytes_in;
+    uint64_t serial_bytes_out;
+
+    // Handlers called when the CPU reaches an address, with one bit per
+    // address set in trap_map for each address that has any
+    uint8_t trap_map[65536 / 8];
+    TRAP traps[MAX_TRAPS];
+    int num_traps;
+
+    uint8_t sending_serial;
+    uint8_t serial_out_count;
+    uint8_t serial_out_byte;
+    uint8_t serial_out_bit_ready;
+
+    uint8_t kim1_serial_mode;
+    // Send OUTCH's characters straight to serial_out rather than bit by bit
+    uint8_t fast_tty;
+    uint8_t flush_policy;
+    // Report writes to addresses with nothing behind them on stderr
+    uint8_t report_stray_writes;
+
+    uint8_t serial_in_queue[SERIAL_IN_QUEUE_SIZE];
+    int serial_in_queue_start;
+    int serial_in_queue_end;
+
+    char paper_tape_filename[1024];
+    FILE *paper_tape_file;
+    int auto_tape;
+    int reading_paper_tape;
+    int writing_paper_tape;
+
+    // RAM pages taken out of the write map by kim1_watch_ram_writes. The
+    // first write to one calls page_written before the write happens.
+    uint8_t watched_pages[256];
+    void (*page_written)(struct KIM1Machine *, int page);
+    // Rewind history, if the host has turned it on
+    struct REWIND *rewind;
+    // Debugger watchpoints. Pages with a watch on them are taken out of
+    // the memory map, with their real pages kept in watch_readmap and
+    // watch_writemap, so only accesses to those pages pay for checking
+    // the per-address bits in watch_read_map and watch_write_map.
+    WATCH watches[MAX_WATCHES];
+    int num_watches;
+    uint8_t watch_pages[256];
+    uint8_t *watch_readmap[256];
+    uint8_t *watch_writemap[256];
+    uint8_t watch_read_map[65536 / 8];
+    uint8_t watch_write_map[65536 / 8];
+    // The last breakpoint or watchpoint hit
+    uint8_t debug_hit;
+    uint16_t debug_addr;
+    uint8_t debug_value;
+
+    // Execution profile and trace, if the host has turned them on
+    struct PROFILE *profile;
+    struct TRACE *trace;
+
+    // Called with each byte the KIM-1 sends out the serial port
+    void (*serial_out)(struct KIM1Machine *, uint8_t);
+    // Called when the ROM starts a paper tape load (writing=0) or
+    // save (writing=1) so the host can open paper_tape_file
+    void (*tape_prompt)(struct KIM1Machine *, int writing);
+    // Free for the host to use
+    void *user;
+} KIM1Machine;
+
+void load_roms();
+void kim1_init(KIM1Machine *m);
+void kim1_set_ram(KIM1Machine *m, int max_ram);
+void build_memory_map(KIM1Machine *m);
+void kim1_watch_ram_writes(KIM1Machine *m);
+void ram_page_written(KIM1Machine *m, int page);
+void kim1_run(KIM1Machine *m, uint32_t cycles);
+void kim1_stop(KIM1Machine *m);
+void kim1_idle(KIM1Machine *m, TRAP_HANDLER trap);
+uint64_t kim1_next_event(KIM1Machine *m);
+uint64_t kim1_cycles(KIM1Machine *m);
+void kim1_schedule(KIM1Machine *m, uint64_t when, EVENT_HANDLER handler);
+void kim1_cancel(KIM1Machine *m, EVENT_HANDLER handler);
+void kim1_set_single_step(KIM1Machine *m, int on);
+void kim1_instruction_hook(CPU6502 *c);
+void check_pc(KIM1Machine *m);
+int kim1_add_trap(KIM1Machine *m, uint16_t addr, TRAP_HANDLER handler);
+void kim1_remove_trap(KIM1Machine *m, uint16_t addr, TRAP_HANDLER handler);
+int kim1_add_breakpoint(KIM1Machine *m, uint16_t addr);
+void kim1_remove_breakpoint(KIM1Machine *m, uint16_t addr);
+int kim1_is_breakpoint(KIM1Machine *m, uint16_t addr);
+void breakpoint_trap(KIM1Machine *m);
+int kim1_add_watch(KIM1Machine *m, uint16_t lo, uint16_t hi, uint8_t flags);
+void kim1_remove_watch(KIM1Machine *m, uint16_t lo, uint16_t hi);
+void kim1_apply_watches(KIM1Machine *m);
+void display_trap(KIM1Machine *m);
+void display_digit(KIM1Machine *m, uint8_t x, uint8_t segments);
+void key_read_trap(KIM1Machine *m);
+void detcps_trap(KIM1Machine *m);
+void key_wait_trap(KIM1Machine *m);
+void getch_trap(KIM1Machine *m);
+void tape_load_trap(KIM1Machine *m);
+void tape_dump_trap(KIM1Machine *m);
+void tape_saved_trap(KIM1Machine *m);
+int kim1_load_tape(KIM1Machine *m, FILE *in);
+void trap_rts(KIM1Machine *m);
+void outch_trap(KIM1Machine *m);
+void outch(KIM1Machine *m);
+void serial_out_stdout(KIM1Machine *m, uint8_t b);
+void serial_out_char(KIM1Machine *m, uint8_t b);
+uint64_t kim1_ram_hash(KIM1Machine *m);
+uint8_t kim1_peek(KIM1Machine *m, uint16_t addr);
+void kim1_poke(KIM1Machine *m, uint16_t addr, uint8_t value);
+int kim1_load_binary(KIM1Machine *m, FILE *in, uint16_t addr);
+
+int serial_in_queue_ready(KIM1Machine *m);
+int serial_in_queue_full(KIM1Machine *m);
+void serial_in_queue_put(KIM1Machine *m, uint8_t b);
+uint8_t serial_in_queue_get(KIM1Machine *m);
+
+uint8_t io_read(KIM1Machine *m, uint16_t);
+void io_write(KIM1Machine *m, uint16_t, uint8_t);
+uint8_t riot003read(KIM1Machine *m, uint16_t);
+uint8_t riot002read(KIM1Machine *m, uint16_t);
+void riot003write(KIM1Machine *m, uint16_t, uint8_t);
+void riot002write(KIM1Machine *m, uint16_t, uint8_t);
+void reset_timer(TIMER *, int, uint8_t, uint64_t);
+int timer_timeout(TIMER *, uint64_t);
+uint8_t timer_count(TIMER *, uint64_t);
+void timer_fast_forward(KIM1Machine *m, TIMER *, uint16_t);
+
+long current_time_millis();
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+static double now_seconds(clockid_t clock) {
+    struct timespec tv;
+    clock_gettime(clock, &tv);
+    return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+/* The read and write system calls made so far, from /proc/self/io, or -1
+ * where that isn't available */
+long metrics_syscalls() {
+    FILE *in;
+    char line[128];
+    long n, total = 0;
+    int found = 0;
+
+    if ((in = fopen("/proc/self/io", "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if ((sscanf(line, "syscr: %ld", &n) == 1) || (sscanf(line, "syscw: %ld", &n) == 1)) {
+            total += n;
+            found++;
+        }
+    }
+    fclose(in);
+    return found == 2 ? total : -1;
+}
+
+static void sample(METRICS *s, METRICS_SAMPLE *t, KIM1Machine *m, PACER *p) {
+    t->time = now_seconds(CLOCK_MONOTONIC);
+    t->cpu_time = now_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    t->cycles = m->cycles_run;
+    t->instructions = m->instructions_run;
+    t->sleeps = p->sleeps;
+    t->display_refreshes = s->display_refreshes;
+    t->serial_bytes_in = m->serial_bytes_in;
+    t->serial_bytes_out = m->serial_bytes_out;
+    t->trap_hits = m->trap_hits;
+    t->idle_cycles = m->idle_cycles;
+    t->syscalls = metrics_syscalls();
+}
+
+/* Start reporting to target, a file name or unix:path for a datagram
+ * socket something else is listening on. Returns -1 if it can't be
+ * opened. */
+int metrics_open(METRICS *s, char *target, KIM1Machine *m, PACER *p) {
+    struct sockaddr_un addr;
+
+    memset(s, 0, sizeof(*s));
+    s->socket = -1;
+    if (!strncmp(target, "unix:", 5)) {
+        if (strlen(target + 5) >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, target + 5);
+        if ((s->socket = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0) {
+            return -1;
+        }
+        // Reports are dropped while nothing is listening, so the collector
+        // can come and go
+        connect(s->socket, (struct sockaddr *) &addr, sizeof(addr));
+    } else {
+        if ((s->file = fopen(target, "a")) == NULL) {
+            return -1;
+        }
+        setvbuf(s->file, NULL, _IOLBF, 0);
+    }
+    sample(s, &s->last, m, p);
+    s->next_report = s->last.time + METRICS_INTERVAL / 1000.0;
+    return 0;
+}
+
+/* Call from the main loop. Cheap until a report is due. */
+void metrics_update(METRICS *s, KIM1Machine *m, PACER *p) {
+    METRICS_SAMPLE t;
+    char line[1024];
+    double secs;
+    int len;
+
+    if (now_seconds(CLOCK_MONOTONIC) < s->next_report) {
+        return;
+    }
+    sample(s, &t, m, p);
+    secs = t.time - s->last.time;
+
+    len = snprintf(line, sizeof(line),
+            "{\"time\": %ld, \"cycles\": %llu, \"instructions\": %llu, "
+            "\"cycles_per_second\": %.0f, \"instructions_per_second\": %.0f, "
+            "\"speed\": %u, \"lag_ms\": %.3f, \"sleeps_per_second\": %.1f, \"idle_percent\": %.1f, "
+            "\"host_cpu_percent\": %.1f, \"syscalls_per_second\": %.1f, "
+            "\"display_refreshes_per_second\": %.1f, \"serial_in_per_second\": %.1f, "
+            "\"serial_out_per_second\": %.1f, \"trap_hits_per_second\": %.1f}\n",
+            (long) time(NULL), (unsigned long long) t.cycles, (unsigned long long) t.instructions,
+            (t.cycles - s->last.cycles) / secs, (t.instructions - s->last.instructions) / secs,
+            p->speed, p->lag / 1e6, (t.sleeps - s->last.sleeps) / secs,
+            t.cycles > s->last.cycles ? 100.0 * (t.idle_cycles - s->last.idle_cycles) / (t.cycles - s->last.cycles) : 0.0,
+            100.0 * (t.cpu_time - s->last.cpu_time) / secs,
+            ((t.syscalls < 0) || (s->last.syscalls < 0)) ? -1.0 : (t.syscalls - s->last.syscalls) / secs,
+            (t.display_refreshes - s->last.display_refreshes) / secs,
+            (t.serial_bytes_in - s->last.serial_bytes_in) / secs,
+            (t.serial_bytes_out - s->last.serial_bytes_out) / secs,
+            (t.trap_hits - s->last.trap_hits) / secs);
+
+    if (s->file) {
+        fwrite(line, 1, len, s->file);
+    } else {
+        send(s->socket, line, len, 0);
+    }
+    s->last = t;
+    s->next_report = t.time + METRICS_INTERVAL / 1000.0;
+}
@@ -0,0 +1,45 @@
+/* Runtime metrics for keeping an eye on a running emulator. Once per
+ * interval of host time a line of JSON is written to a stats file, or sent
+ * as a datagram to a local Unix socket, with the totals and per-second
+ * rates of cycles, instructions, sleeps, display refreshes, serial bytes
+ * and trap hits, along with the pacing lag, the share of cycles spent
+ * idle and host CPU use. */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "kim1machine.h"
+#include "pacer.h"
+
+// Milliseconds between reports
+#define METRICS_INTERVAL 1000
+
+// The counters at the last report, for working out the rates
+typedef struct METRICS_SAMPLE {
+    double time;
+    double cpu_time;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t sleeps;
+    uint64_t display_refreshes;
+    uint64_t serial_bytes_in;
+    uint64_t serial_bytes_out;
+    uint64_t trap_hits;
+    uint64_t idle_cycles;
+    long syscalls;
+} METRICS_SAMPLE;
+
+typedef struct METRICS {
+    FILE *file;                 // the stats file, or
+    int socket;                 // the socket, -1 if not using one
+    uint64_t display_refreshes; // counted by the front end
+    double next_report;
+    METRICS_SAMPLE last;
+} METRICS;
+
+int metrics_open(METRICS *s, char *target, KIM1Machine *m, PACER *p);
+void metrics_update(METRICS *s, KIM1Machine *m, PACER *p);
+long metrics_syscalls();
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pacer.h"
+
+// One slice is a millisecond of host time
+#define SLICE_NANOS 1000000L
+// If we fall further behind than this (a file prompt, a stopped process)
+// give up on catching up and start pacing again from now
+#define MAX_LAG_NANOS 100000000L
+// Cycles per slice when running unthrottled
+#define UNTHROTTLED_SLICE 100000
+// The longest an idle machine sleeps without looking at its events
+#define MAX_IDLE_NANOS 100000000L
+// The fastest multiple -speed takes, a 100 GHz KIM-1 is plenty
+#define MAX_SPEED 100000
+
+/* Parse a -speed argument: 1x, 10x (any multiple up to MAX_SPEED) or max */
+int parse_speed(char *arg, uint32_t *speed) {
+    char *end;
+    long mult;
+
+    if (!strcmp(arg, "max")) {
+        *speed = 0;
+        return 0;
+    }
+    mult = strtol(arg, &end, 10);
+    if ((end == arg) || (mult < 1) || (mult > MAX_SPEED) || ((*end != 0) && strcmp(end, "x") && strcmp(end, "X"))) {
+        return -1;
+    }
+    *speed = mult;
+    return 0;
+}
+
+void pacer_start(PACER *p, uint32_t speed) {
+    p->speed = speed;
+    p->slice = speed ? (uint32_t) ((uint64_t) speed * (SLICE_NANOS / 1000)) : UNTHROTTLED_SLICE;
+    p->lag = 0;
+    p->sleeps = 0;
+    clock_gettime(CLOCK_MONOTONIC, &p->deadline);
+}
+
+/* Call after running each slice. Sleeps until the slice's deadline and
+ * moves the deadline on to the end of the next slice. */
+void pacer_wait(PACER *p) {
+    struct timespec now;
+    long lag;
+
+    if (!p->speed) {
+        return;
+    }
+
+    p->deadline.tv_nsec += SLICE_NANOS;
+    if (p->deadline.tv_nsec >= 1000000000L) {
+        p->deadline.tv_nsec -= 1000000000L;
+        p->deadline.tv_sec++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    lag = (now.tv_sec - p->deadline.tv_sec) * 1000000000L + (now.tv_nsec - p->deadline.tv_nsec);
+    p->lag = lag > 0 ? lag : 0;
+    if (lag > MAX_LAG_NANOS) {
+        p->deadline = now;
+    } else if (lag < 0) {
+        p->sleeps++;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p->deadline, NULL);
+    }
+}
+
+/* While the machine is idle the host sleeps through as many slices as it
+ * likes in one go. pacer_idle_deadline gives the time to sleep until, the
+ * given number of cycles after the end of the last slice, and once awake
+ * pacer_idle_end returns the cycles the machine has to run to catch up
+ * and paces on from there. Unthrottled, an idle machine keeps to 1x rather
+ * than racing ahead through its wait loops. */
+void pacer_idle_deadline(PACER *p, uint64_t cycles, struct timespec *until) {
+    uint32_t speed = p->speed ? p->speed : 1;
+    long nanos;
+
+    if (!p->speed) {
+        clock_gettime(CLOCK_MONOTONIC, &p->deadline);
+    }
+    nanos = cycles < (uint64_t) MAX_IDLE_NANOS * speed / 1000 ? (long) (cycles * 1000 / speed) : MAX_IDLE_NANOS;
+    *until = p->deadline;
+    until->tv_nsec += nanos;
+    until->tv_sec += until->tv_nsec / 1000000000L;
+    until->tv_nsec %= 1000000000L;
+}
+
+uint32_t pacer_idle_end(PACER *p) {
+    uint32_t speed = p->speed ? p->speed : 1;
+    struct timespec now;
+    long nanos;
+    uint64_t cycles;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nanos = (now.tv_sec - p->deadline.tv_sec) * 1000000000L + (now.tv_nsec - p->deadline.tv_nsec);
+    if (nanos > MAX_IDLE_NANOS) {
+        nanos = MAX_IDLE_NANOS;
+    }
+    // Always move on by at least a cycle, and at high speeds no more than
+    // fits in a run
+    cycles = nanos > 0 ? (uint64_t) nanos * speed / 1000 : 0;
+    if (cycles == 0) {
+        cycles = 1;
+    } else if (cycles > UINT32_MAX) {
+        cycles = UINT32_MAX;
+    }
+    p->sleeps++;
+    p->lag = 0;
+    p->deadline.tv_nsec += (long) (cycles * 1000 / speed);
+    p->deadline.tv_sec += p->deadline.tv_nsec / 1000000000L;
+    p->deadline.tv_nsec %= 1000000000L;
+    return (uint32_t) cycles;
+}
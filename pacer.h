@@ -0,0 +1,25 @@
+/* Pacing for running the emulator at a fixed multiple of the KIM-1's 1 MHz
+ * clock. Rather than checking the clock around every instruction, the CPU
+ * runs a slice of cycles at a time and then sleeps once, until an absolute
+ * deadline, so timing errors don't accumulate. */
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <time.h>
+
+typedef struct PACER {
+    uint32_t speed;             // multiple of 1 MHz, 0 means run unthrottled
+    uint32_t slice;             // emulated cycles to run between sleeps
+    struct timespec deadline;   // when the current slice should end
+    long lag;                   // how far behind the last deadline, in ns
+    uint64_t sleeps;
+} PACER;
+
+int parse_speed(char *arg, uint32_t *speed);
+void pacer_start(PACER *p, uint32_t speed);
+void pacer_wait(PACER *p);
+void pacer_idle_deadline(PACER *p, uint64_t cycles, struct timespec *until);
+uint32_t pacer_idle_end(PACER *p);
+
+#endif
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "profile.h"
+#include "disasm.h"
+
+void profile_start(KIM1Machine *m) {
+    PROFILE *p = calloc(1, sizeof(PROFILE));
+
+    p->pc = m->cpu.pc;
+    p->ticks = m->cpu.clockticks6502;
+    m->profile = p;
+}
+
+static PROFILE *sort_profile;
+
+static int by_cycles(const void *a, const void *b) {
+    uint64_t ca = sort_profile->cycles[*(uint16_t *) a];
+    uint64_t cb = sort_profile->cycles[*(uint16_t *) b];
+
+    if (ca != cb) {
+        return ca < cb ? 1 : -1;
+    }
+    return *(uint16_t *) a - *(uint16_t *) b;
+}
+
+/* Write every address that ran, hottest first, with its share of the
+ * cycles, the running total and the instruction there. */
+void profile_report(KIM1Machine *m, FILE *out) {
+    PROFILE *p = m->profile;
+    uint16_t *addrs;
+    int num_addrs = 0;
+    uint64_t total_count = 0, total_cycles = 0, running = 0;
+    uint8_t bytes[3];
+    char text[64];
+
+    if (p == NULL) {
+        return;
+    }
+    addrs = malloc(65536 * sizeof(uint16_t));
+    for (int i=0; i < 65536; i++) {
+        if (p->count[i]) {
+            addrs[num_addrs++] = i;
+            total_count += p->count[i];
+            total_cycles += p->cycles[i];
+        }
+    }
+    sort_profile = p;
+    qsort(addrs, num_addrs, sizeof(uint16_t), by_cycles);
+
+    fprintf(out, "%llu instructions, %llu cycles at %d addresses\n\n",
+            (unsigned long long) total_count, (unsigned long long) total_cycles, num_addrs);
+    fprintf(out, "addr        count       cycles  cycles%%  cumul%%  instruction\n");
+    for (int i=0; i < num_addrs; i++) {
+        uint16_t addr = addrs[i];
+
+        for (int j=0; j < 3; j++) {
+            bytes[j] = kim1_peek(m, addr + j);
+        }
+        disasm6502(addr, bytes, text, sizeof(text));
+        running += p->cycles[addr];
+        fprintf(out, "%04x %12llu %12llu  %6.2f  %6.2f  %s\n", addr,
+                (unsigned long long) p->count[addr], (unsigned long long) p->cycles[addr],
+                100.0 * p->cycles[addr] / total_cycles, 100.0 * running / total_cycles, text);
+    }
+    free(addrs);
+}
@@ -0,0 +1,23 @@
+/* Execution profiler. Every instruction's execution count and cycles,
+ * including page crossing and branch penalties, are added up by the
+ * address it starts at in flat 64K arrays, so profiling costs a couple of
+ * adds per instruction. The report lists the addresses by cycles used
+ * with each one disassembled. */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "kim1machine.h"
+
+typedef struct PROFILE {
+    uint64_t count[65536];
+    uint64_t cycles[65536];
+    uint16_t pc;                // where the instruction now running started
+    uint32_t ticks;             // clockticks6502 when it started
+} PROFILE;
+
+void profile_start(KIM1Machine *m);
+void profile_report(KIM1Machine *m, FILE *out);
+
+#endif
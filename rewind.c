@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+
+// A checkpoint every 100ms of emulated time
+#define REWIND_INTERVAL 100000
+// Most RAM the undo pages may hold, the oldest checkpoints are dropped
+// to stay under it
+#define REWIND_MAX_PAGE_BYTES (16L * 1024 * 1024)
+
+/* Keep the last given number of seconds of emulated time */
+void rewind_start(KIM1Machine *m, int seconds) {
+    REWIND *r = calloc(1, sizeof(REWIND));
+
+    r->interval = REWIND_INTERVAL;
+    r->capacity = (int) ((uint64_t) seconds * 1000000 / REWIND_INTERVAL) + 1;
+    r->ring = calloc(r->capacity, sizeof(CHECKPOINT));
+    r->max_page_bytes = REWIND_MAX_PAGE_BYTES;
+
+    m->rewind = r;
+    m->page_written = rewind_page_written;
+    rewind_event(m);
+}
+
+void drop_oldest(REWIND *r) {
+    CHECKPOINT *cp = &r->ring[r->first];
+
+    r->page_bytes -= (long) cp->size_pages * sizeof(REWIND_PAGE);
+    free(cp->pages);
+    memset(cp, 0, sizeof(CHECKPOINT));
+    r->first = (r->first + 1) % r->capacity;
+    r->count--;
+}
+
+void rewind_checkpoint(KIM1Machine *m) {
+    REWIND *r = m->rewind;
+    CHECKPOINT *cp;
+
+    if (r->count == r->capacity) {
+        drop_oldest(r);
+    }
+    cp = &r->ring[(r->first + r->count) % r->capacity];
+    r->count++;
+    snapshot_capture(m, &cp->state);
+    cp->num_pages = 0;
+
+    kim1_watch_ram_writes(m);
+}
+
+void rewind_event(KIM1Machine *m) {
+    rewind_checkpoint(m);
+    kim1_schedule(m, kim1_cycles(m) + m->rewind->interval, rewind_event);
+}
+
+/* First write to a page since the last checkpoint, save what it held */
+void rewind_page_written(KIM1Machine *m, int page) {
+    REWIND *r = m->rewind;
+    CHECKPOINT *cp = &r->ring[(r->first + r->count - 1) % r->capacity];
+    int size;
+
+    if (cp->num_pages == cp->size_pages) {
+        size = cp->size_pages ? cp->size_pages * 2 : 4;
+        cp->pages = realloc(cp->pages, size * sizeof(REWIND_PAGE));
+        r->page_bytes += (long) (size - cp->size_pages) * sizeof(REWIND_PAGE);
+        cp->size_pages = size;
+    }
+    cp->pages[cp->num_pages].page = page;
+    memcpy(cp->pages[cp->num_pages].data, &m->ram[page * 256], 256);
+    cp->num_pages++;
+
+    while ((r->page_bytes > r->max_page_bytes) && (r->count > 1)) {
+        drop_oldest(r);
+    }
+}
+
+/* Go back to the newest checkpoint at least the given number of seconds
+ * ago, or the oldest one there is. Returns how many seconds of emulated
+ * time were actually undone. */
+double rewind_back(KIM1Machine *m, double seconds) {
+    REWIND *r = m->rewind;
+    uint64_t now = kim1_cycles(m);
+    uint64_t back = (uint64_t) (seconds * 1000000);
+    CHECKPOINT *cp;
+    int target, i;
+
+    if ((r == NULL) || (r->count == 0)) {
+        return 0;
+    }
+    for (target = r->count - 1; target > 0; target--) {
+        cp = &r->ring[(r->first + target) % r->capacity];
+        if (now - cp->state.cycles >= back) break;
+    }
+
+    // Undo the RAM writes, newest checkpoint first
+    for (i = r->count - 1; i >= target; i--) {
+        cp = &r->ring[(r->first + i) % r->capacity];
+        for (int p = cp->num_pages - 1; p >= 0; p--) {
+            memcpy(&m->ram[cp->pages[p].page * 256], cp->pages[p].data, 256);
+        }
+        cp->num_pages = 0;
+        if (i > target) {
+            r->page_bytes -= (long) cp->size_pages * sizeof(REWIND_PAGE);
+            free(cp->pages);
+            cp->pages = NULL;
+            cp->size_pages = 0;
+        }
+    }
+    r->count = target + 1;
+
+    cp = &r->ring[(r->first + target) % r->capacity];
+    snapshot_restore(m, &cp->state);
+
+    // The target checkpoint starts collecting pages again from here
+    kim1_watch_ram_writes(m);
+    return (double) (now - cp->state.cycles) / 1000000;
+}
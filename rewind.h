@@ -0,0 +1,41 @@
+/* Rewind history. A checkpoint of the machine state is taken every
+ * interval, and RAM is kept as an undo log: the first time a page is
+ * written after a checkpoint, its old contents are saved with that
+ * checkpoint. Rewinding puts the saved pages back, newest first, and then
+ * restores the checkpoint's state. Pages nobody writes cost nothing. */
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+#include "kim1machine.h"
+#include "snapshot.h"
+
+typedef struct REWIND_PAGE {
+    uint8_t page;
+    uint8_t data[256];
+} REWIND_PAGE;
+
+typedef struct CHECKPOINT {
+    SNAPSHOT state;
+    REWIND_PAGE *pages;         // RAM pages as they were at the checkpoint
+    int num_pages;
+    int size_pages;
+} CHECKPOINT;
+
+typedef struct REWIND {
+    CHECKPOINT *ring;
+    int capacity;
+    int first;                  // oldest checkpoint
+    int count;
+    uint32_t interval;          // cycles between checkpoints
+    long page_bytes;            // RAM held by all the checkpoints' pages
+    long max_page_bytes;
+} REWIND;
+
+void rewind_start(KIM1Machine *m, int seconds);
+void rewind_checkpoint(KIM1Machine *m);
+void rewind_event(KIM1Machine *m);
+void rewind_page_written(KIM1Machine *m, int page);
+double rewind_back(KIM1Machine *m, double seconds);
+
+#endif
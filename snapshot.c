@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+/* Capture everything but RAM into s */
+void snapshot_capture(KIM1Machine *m, SNAPSHOT *s) {
+    memset(s, 0, sizeof(*s));
+    memcpy(s->magic, SNAPSHOT_MAGIC, sizeof(s->magic));
+    s->version = SNAPSHOT_VERSION;
+    s->header_size = sizeof(SNAPSHOT);
+    s->max_ram = m->max_ram;
+    s->instructions = m->cpu.instructions;
+    s->cycles = kim1_cycles(m);
+
+    s->pc = m->cpu.pc;
+    s->sp = m->cpu.sp;
+    s->a = m->cpu.a;
+    s->x = m->cpu.x;
+    s->y = m->cpu.y;
+    s->status = m->cpu.status;
+
+    memcpy(s->display, m->display, sizeof(s->display));
+    s->char_pending = m->char_pending;
+    s->single_step = m->single_step;
+    s->enable_SST_NMI = m->enable_SST_NMI;
+    s->kim1_serial_mode = m->kim1_serial_mode;
+    s->sending_serial = m->sending_serial;
+    s->serial_out_count = m->serial_out_count;
+    s->serial_out_byte = m->serial_out_byte;
+    s->serial_out_bit_ready = m->serial_out_bit_ready;
+
+    s->riot003 = m->riot003;
+    s->riot002 = m->riot002;
+
+    s->serial_in_queue_start = m->serial_in_queue_start;
+    s->serial_in_queue_end = m->serial_in_queue_end;
+    memcpy(s->serial_in_queue, m->serial_in_queue, sizeof(s->serial_in_queue));
+}
+
+/* Put back everything snapshot_capture saved. RAM and max_ram are left to
+ * the caller. */
+void snapshot_restore(KIM1Machine *m, SNAPSHOT *s) {
+    uint64_t now;
+
+    m->cpu.pc = s->pc;
+    m->cpu.sp = s->sp;
+    m->cpu.a = s->a;
+    m->cpu.x = s->x;
+    m->cpu.y = s->y;
+    m->cpu.status = s->status;
+    m->cpu.instructions = s->instructions;
+
+    // Pick the cycle count up where the snapshot left off, so the RIOT
+    // timers, which are kept relative to it, carry on running. Events
+    // already on the schedule keep their distance from now.
+    now = kim1_cycles(m);
+    for (int i=0; i < m->num_events; i++) {
+        m->events[i].when = m->events[i].when - now + s->cycles;
+    }
+    m->cycles_base = s->cycles;
+    m->ticks_base = m->cpu.clockticks6502;
+    m->instructions_base = m->cpu.instructions;
+
+    memcpy(m->display, s->display, sizeof(m->display));
+    m->display_changed = 1;
+    m->char_pending = s->char_pending;
+    m->enable_SST_NMI = s->enable_SST_NMI;
+    m->kim1_serial_mode = s->kim1_serial_mode;
+    m->sending_serial = s->sending_serial;
+    m->serial_out_count = s->serial_out_count;
+    m->serial_out_byte = s->serial_out_byte;
+    m->serial_out_bit_ready = s->serial_out_bit_ready;
+
+    m->riot003 = s->riot003;
+    m->riot002 = s->riot002;
+
+    m->serial_in_queue_start = s->serial_in_queue_start;
+    m->serial_in_queue_end = s->serial_in_queue_end;
+    memcpy(m->serial_in_queue, s->serial_in_queue, sizeof(m->serial_in_queue));
+
+    kim1_set_single_step(m, s->single_step);
+}
+
+/* Write the machine's state to filename. Returns 0, or -1 with errno set
+ * if the file couldn't be written. */
+int snapshot_save(KIM1Machine *m, char *filename) {
+    SNAPSHOT s;
+    FILE *out;
+    int ok;
+
+    snapshot_capture(m, &s);
+    if ((out = fopen(filename, "wb")) == NULL) {
+        return -1;
+    }
+    ok = (fwrite(&s, sizeof(s), 1, out) == 1) &&
+        (fwrite(m->ram, m->max_ram, 1, out) == 1);
+    if ((fclose(out) != 0) || !ok) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Restore the machine from a snapshot file. The machine should already
+ * have been through kim1_init, so the hooks and traps are in place.
+ * Returns 0, or -1 if the file can't be read or isn't a snapshot this
+ * version understands. */
+int snapshot_load(KIM1Machine *m, char *filename) {
+    SNAPSHOT *s;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(SNAPSHOT))) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    s = (SNAPSHOT *) map;
+    if (memcmp(s->magic, SNAPSHOT_MAGIC, sizeof(s->magic)) ||
+            (s->version != SNAPSHOT_VERSION) ||
+            (s->header_size != sizeof(SNAPSHOT)) ||
+            (s->max_ram > sizeof(m->ram)) ||
+            (st.st_size < (off_t) (sizeof(SNAPSHOT) + s->max_ram))) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    memcpy(m->ram, (uint8_t *) map + sizeof(SNAPSHOT), s->max_ram);
+    kim1_set_ram(m, s->max_ram);
+    snapshot_restore(m, s);
+
+    munmap(map, st.st_size);
+    return 0;
+}
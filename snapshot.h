@@ -0,0 +1,50 @@
+/* Machine snapshots. A snapshot file is a fixed header holding the CPU
+ * registers, both RIOTs, the display, keyboard and serial state, followed
+ * by max_ram bytes of RAM. Everything is stored in host byte order exactly
+ * as it sits in the SNAPSHOT struct, so loading is an mmap and a few
+ * copies, with no parsing. */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "kim1machine.h"
+
+#define SNAPSHOT_MAGIC "KIM1SNAP"
+// Bump this whenever the layout of SNAPSHOT or anything in it changes
+#define SNAPSHOT_VERSION 1
+
+typedef struct SNAPSHOT {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       // sizeof(SNAPSHOT), RAM follows it
+    uint32_t max_ram;
+    uint32_t instructions;
+    uint64_t cycles;
+
+    uint16_t pc;
+    uint8_t sp, a, x, y, status;
+
+    uint8_t display[6];
+    uint8_t char_pending;
+    uint8_t single_step;
+    uint8_t enable_SST_NMI;
+    uint8_t kim1_serial_mode;
+    uint8_t sending_serial;
+    uint8_t serial_out_count;
+    uint8_t serial_out_byte;
+    uint8_t serial_out_bit_ready;
+
+    RIOT riot003;
+    RIOT riot002;
+
+    int32_t serial_in_queue_start;
+    int32_t serial_in_queue_end;
+    uint8_t serial_in_queue[SERIAL_IN_QUEUE_SIZE];
+} SNAPSHOT;
+
+void snapshot_capture(KIM1Machine *m, SNAPSHOT *s);
+void snapshot_restore(KIM1Machine *m, SNAPSHOT *s);
+int snapshot_save(KIM1Machine *m, char *filename);
+int snapshot_load(KIM1Machine *m, char *filename);
+
+#endif
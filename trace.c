@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+static void write_header(FILE *out) {
+    TRACE_HEADER h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    h.version = TRACE_VERSION;
+    h.record_size = sizeof(TRACE_RECORD);
+    fwrite(&h, sizeof(h), 1, out);
+}
+
+static void start(KIM1Machine *m, int records, FILE *file) {
+    TRACE *t = calloc(1, sizeof(TRACE));
+    int size = 1;
+
+    while (size < records) {
+        size <<= 1;
+    }
+    t->records = malloc(size * sizeof(TRACE_RECORD));
+    t->mask = size - 1;
+    t->file = file;
+    t->pc = m->cpu.pc;
+    m->trace = t;
+}
+
+/* Trace every instruction to a file */
+int trace_start_file(KIM1Machine *m, char *filename) {
+    FILE *out;
+
+    if ((out = fopen(filename, "wb")) == NULL) {
+        return -1;
+    }
+    write_header(out);
+    start(m, TRACE_STREAM_RECORDS, out);
+    return 0;
+}
+
+/* Keep the last records instructions (rounded up to a power of 2) in
+ * memory, for trace_dump */
+void trace_start_ring(KIM1Machine *m, int records) {
+    start(m, records, NULL);
+}
+
+/* Write out the part of a streaming trace's buffer that hasn't been */
+void trace_flush(KIM1Machine *m) {
+    TRACE *t = m->trace;
+    uint64_t n = t->count & t->mask;
+
+    if (n == 0) {
+        n = t->mask + 1;
+    }
+    fwrite(t->records, sizeof(TRACE_RECORD), n, t->file);
+}
+
+/* Write the ring's records to a file, oldest first */
+int trace_dump(KIM1Machine *m, char *filename) {
+    TRACE *t = m->trace;
+    uint64_t size = t->mask + 1;
+    uint64_t first = t->count > size ? t->count - size : 0;
+    FILE *out;
+
+    if ((out = fopen(filename, "wb")) == NULL) {
+        return -1;
+    }
+    write_header(out);
+    for (uint64_t i = first; i < t->count; i++) {
+        fwrite(&t->records[i & t->mask], sizeof(TRACE_RECORD), 1, out);
+    }
+    fclose(out);
+    return 0;
+}
+
+/* Finish a streaming trace and turn tracing off */
+void trace_stop(KIM1Machine *m) {
+    TRACE *t = m->trace;
+
+    if (t->file) {
+        if (t->count & t->mask) {
+            trace_flush(m);
+        }
+        fclose(t->file);
+    }
+    free(t->records);
+    free(t);
+    m->trace = NULL;
+}
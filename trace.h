@@ -0,0 +1,49 @@
+/* Binary execution trace. Each instruction is written as a fixed-size
+ * record into a buffer, which is either written out to a file whenever it
+ * fills up, or kept as a ring of the last instructions run and written out
+ * only when asked, after a run has gone wrong. kim1-tracedump turns a trace
+ * file back into text. */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "kim1machine.h"
+
+#define TRACE_MAGIC "KIM1TRAC"
+#define TRACE_VERSION 1
+
+// Records in the buffer when streaming to a file
+#define TRACE_STREAM_RECORDS 65536
+
+typedef struct TRACE_HEADER {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} TRACE_HEADER;
+
+typedef struct TRACE_RECORD {
+    uint64_t cycle;             // machine cycle the instruction finished on
+    uint16_t pc;                // where the instruction started
+    uint16_t ea;                // effective address, if the mode has one
+    uint8_t opcode, op1, op2;   // the instruction bytes
+    uint8_t a, x, y, sp, status; // registers after the instruction
+    uint8_t pad[4];
+} TRACE_RECORD;
+
+typedef struct TRACE {
+    TRACE_RECORD *records;
+    uint64_t mask;              // number of records - 1, a power of 2
+    uint64_t count;             // records written since the start
+    FILE *file;                 // where the buffer goes when it fills, or
+                                // NULL to keep a ring of the last records
+    uint16_t pc;                // where the instruction now running started
+} TRACE;
+
+int trace_start_file(KIM1Machine *m, char *filename);
+void trace_start_ring(KIM1Machine *m, int records);
+void trace_flush(KIM1Machine *m);
+int trace_dump(KIM1Machine *m, char *filename);
+void trace_stop(KIM1Machine *m);
+
+#endif
@@ -0,0 +1,98 @@
+/* kim1-tracedump prints a binary trace written by kim1 -trace as text,
+ * one instruction per line:
+ *
+ *     cycle  pc  bytes  instruction  registers after  [ea]
+ *
+ * -pc lo:hi and -ea lo:hi (hex, inclusive) only print the instructions
+ * that start in, or access memory in, an address range. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "disasm.h"
+
+typedef struct RANGE {
+    int set;
+    uint16_t lo, hi;
+} RANGE;
+
+void usage() {
+    printf("Usage:  kim1-tracedump [-pc lo:hi] [-ea lo:hi] tracefile\n");
+}
+
+int parse_range(char *arg, RANGE *r) {
+    unsigned int lo, hi;
+
+    if (sscanf(arg, "%x:%x", &lo, &hi) != 2) {
+        return -1;
+    }
+    r->set = 1;
+    r->lo = lo;
+    r->hi = hi;
+    return 0;
+}
+
+int in_range(RANGE *r, uint16_t addr) {
+    return !r->set || ((addr >= r->lo) && (addr <= r->hi));
+}
+
+int main(int argc, char *argv[]) {
+    char *filename = NULL;
+    RANGE pc_range = { 0 }, ea_range = { 0 };
+    TRACE_HEADER h;
+    TRACE_RECORD r;
+    FILE *in;
+    uint8_t bytes[3];
+    char text[64];
+    int has_ea;
+
+    for (int i=1; i < argc; i++) {
+        if (!strcmp(argv[i], "-pc") || !strcmp(argv[i], "-ea")) {
+            if ((i >= argc-1) || (parse_range(argv[i+1], !strcmp(argv[i], "-pc") ? &pc_range : &ea_range) < 0)) {
+                usage();
+                exit(1);
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-help") ||
+            !strcmp(argv[i], "--h") || !strcmp(argv[i], "--help")) {
+            usage();
+            exit(0);
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (filename == NULL) {
+        usage();
+        exit(1);
+    }
+
+    if ((in = fopen(filename, "rb")) == NULL) {
+        perror(filename);
+        exit(1);
+    }
+    if ((fread(&h, sizeof(h), 1, in) != 1) || memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) ||
+            (h.version != TRACE_VERSION) || (h.record_size != sizeof(TRACE_RECORD))) {
+        fprintf(stderr, "%s is not a KIM-1 trace\n", filename);
+        exit(1);
+    }
+
+    while (fread(&r, sizeof(r), 1, in) == 1) {
+        has_ea = disasm6502_has_ea(r.opcode);
+        if (!in_range(&pc_range, r.pc) || (ea_range.set && (!has_ea || !in_range(&ea_range, r.ea)))) {
+            continue;
+        }
+        bytes[0] = r.opcode;
+        bytes[1] = r.op1;
+        bytes[2] = r.op2;
+        disasm6502(r.pc, bytes, text, sizeof(text));
+        printf("%12llu  %04x  %-24s a=%02x x=%02x y=%02x sp=%02x p=%02x",
+                (unsigned long long) r.cycle, r.pc, text, r.a, r.x, r.y, r.sp, r.status);
+        if (has_ea) {
+            printf("  ea=%04x", r.ea);
+        }
+        printf("\n");
+    }
+    fclose(in);
+    return 0;
+}